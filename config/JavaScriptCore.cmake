@@ -9,3 +9,33 @@ elseif(UNIX)
     SET(JSC_INCLUDE_DIRS ${JSC_INCLUDE_DIR})
 
 endif()
+
+# Optional parts of the JavaScriptCore API
+# ---------------------------------------
+# Note: these are only available with newer versions of JavaScriptCore
+
+include(CheckCXXSourceCompiles)
+
+set(CMAKE_REQUIRED_INCLUDES ${JSC_INCLUDE_DIRS})
+set(CMAKE_REQUIRED_LIBRARIES ${JSC} ${JSC_LIBRARIES})
+
+check_cxx_source_compiles("
+  #include <JavaScriptCore/JavaScript.h>
+  int main() { return JSValueIsArray(0, 0) ? 1 : 0; }
+" JSC_HAVE_JSVALUEISARRAY)
+
+if (JSC_HAVE_JSVALUEISARRAY)
+  add_definitions(-DJSOBJECTS_JSC_HAVE_JSVALUEISARRAY)
+endif ()
+
+check_cxx_source_compiles("
+  #include <JavaScriptCore/JavaScript.h>
+  int main() { return JSObjectMakeTypedArray(0, kJSTypedArrayTypeFloat64Array, 0, 0) ? 1 : 0; }
+" JSC_HAVE_TYPED_ARRAYS)
+
+if (JSC_HAVE_TYPED_ARRAYS)
+  add_definitions(-DJSOBJECTS_JSC_HAVE_TYPED_ARRAYS)
+endif ()
+
+unset(CMAKE_REQUIRED_INCLUDES)
+unset(CMAKE_REQUIRED_LIBRARIES)
@@ -1,6 +1,8 @@
 #include <jsobjects.hpp>
 #include <iostream>
 
+// Note: the argument is borrowed, i.e., passing it does not allocate,
+//   and it must not be kept beyond the call
 void acceptValue(JSValuePtr val) {
   switch (val->getType()) {
     case JSValue::String:
@@ -0,0 +1,23 @@
+var COUNT = 100000;
+var RUNS = 20;
+
+function measure(name, f) {
+  var start = Date.now();
+  var result;
+  for (var run = 0; run < RUNS; ++run) {
+    result = f();
+  }
+  print(name + ": " + (Date.now() - start) + " ms (result: " + result + ")");
+}
+
+var samples = vector_benchmark.createSamples(COUNT);
+var plain = [];
+for (var idx = 0; idx < COUNT; ++idx) {
+  plain.push(0.5 * idx);
+}
+
+measure("create (vector)", function() { return vector_benchmark.createSamples(COUNT).length; });
+measure("create (per element)", function() { return vector_benchmark.createSamplesPerElement(this, COUNT).length; });
+measure("sum (vector, typed array)", function() { return vector_benchmark.sum(samples); });
+measure("sum (vector, plain array)", function() { return vector_benchmark.sum(plain); });
+measure("sum (per element)", function() { return vector_benchmark.sumPerElement(plain); });
@@ -0,0 +1,38 @@
+#include <jsobjects.hpp>
+#include <vector>
+
+// Note: the vector is converted by the typemaps of jsobjects.i,
+//   i.e., copied into a Float64Array at once
+std::vector<double> createSamples(int count) {
+  std::vector<double> result(count);
+  for (int idx = 0; idx < count; ++idx) {
+    result[idx] = 0.5 * idx;
+  }
+  return result;
+}
+
+// the same data, created element by element through the jsobjects API
+JSArrayPtr createSamplesPerElement(JSContextPtr context, int count) {
+  JSArrayPtr result = context->newArray(count);
+  for (int idx = 0; idx < count; ++idx) {
+    result->setAt(idx, context->newNumber(0.5 * idx));
+  }
+  return result;
+}
+
+double sum(const std::vector<double>& samples) {
+  double result = 0;
+  for (size_t idx = 0; idx < samples.size(); ++idx) {
+    result += samples[idx];
+  }
+  return result;
+}
+
+double sumPerElement(JSArrayPtr samples) {
+  double result = 0;
+  unsigned int length = samples->length();
+  for (unsigned int idx = 0; idx < length; ++idx) {
+    result += samples->getAt(idx)->asDouble();
+  }
+  return result;
+}
@@ -0,0 +1,9 @@
+%module vector_benchmark
+
+%header %{
+#include <vector_benchmark.hpp>
+%}
+
+%include <jsobjects.i>
+
+%include "vector_benchmark.hpp"
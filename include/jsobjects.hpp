@@ -3,7 +3,10 @@
 
 #include <string>
 #include <vector>
+#include <new>
+#include <type_traits>
 #include <assert.h>
+#include <string.h>
 
 #include <boost/shared_ptr.hpp>
 
@@ -15,11 +18,15 @@ class JSValue;
 class JSObject;
 class JSArray;
 class JSContext;
+class JSPropertyKey;
+class JSNativeCallback;
 
 typedef boost::shared_ptr< JSValue > JSValuePtr;
 typedef boost::shared_ptr< JSObject > JSObjectPtr;
 typedef boost::shared_ptr< JSArray > JSArrayPtr;
 typedef boost::shared_ptr< JSContext > JSContextPtr;
+typedef boost::shared_ptr< JSPropertyKey > JSPropertyKeyPtr;
+typedef boost::shared_ptr< JSNativeCallback > JSNativeCallbackPtr;
 
 #define JSOBJECTS_PTR_TYPE(type) boost::shared_ptr< type >
 #define JSOBJECTS_PTR_GET(val) val.get()
@@ -45,6 +52,9 @@ public:
 
   virtual std::string asString() = 0;
 
+  // Writes the string into 'result' reusing its buffer.
+  virtual void asString(std::string& result) = 0;
+
   virtual double asDouble() = 0;
 
   virtual bool asBool() = 0;
@@ -61,6 +71,10 @@ public:
 
   virtual JSValuePtr toValue(JSObjectPtr obj) = 0;
 
+  // Returns the backend object (e.g., the JSValueJSC) behind this value.
+  // Note: lets backends and bindings downcast without RTTI, as JSValue is a virtual base
+  virtual void* getImpl() = 0;
+
   inline int asInteger();
 
   inline bool isNull();
@@ -78,29 +92,203 @@ public:
   inline bool isArray();
 };
 
+/**
+ * Tag for wrappers that borrow an engine value for the duration of a
+ * native call, e.g., arguments of a wrapped function.
+ *
+ * A borrowed wrapper neither protects the value nor allocates a persistent
+ * handle, as the engine keeps the value alive until the call returns.
+ * Such wrappers are meant to live on the stack (see JSStackValue).
+ */
+struct JSBorrowed {};
+
+/**
+ * Storage for a wrapper on the stack which is constructed on demand.
+ *
+ * Used by bindings to pass arguments (e.g., JSValuePtr or JSValue&)
+ * without any heap allocation. A JSValuePtr to such a wrapper is created
+ * with the aliasing constructor of an empty pointer, i.e., it does not own
+ * the wrapper and must not be kept beyond the call:
+ *
+ *     JSStackValue<JSValueJSC> temp;
+ *     JSValuePtr val(JSValuePtr(), temp.init(context, input, JSBorrowed()));
+ */
+template <typename T>
+class JSStackValue {
+
+public:
+
+  JSStackValue(): constructed(false) {}
+
+  ~JSStackValue() {
+    if(constructed) get()->~T();
+  }
+
+  template <typename... Args>
+  T* init(Args... args) {
+    assert(!constructed);
+    new (&storage) T(args...);
+    constructed = true;
+    return get();
+  }
+
+  T* get() {
+    return reinterpret_cast<T*>(&storage);
+  }
+
+private:
+
+  typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+  bool constructed;
+
+  JSStackValue(const JSStackValue&);
+  JSStackValue& operator=(const JSStackValue&);
+};
+
+/**
+ * A reference to a NUL-terminated string, e.g., a literal or a std::string.
+ *
+ * Used for property keys so that passing a literal does not construct a
+ * temporary std::string.
+ *
+ * Note: the referenced string must outlive the view.
+ */
+class JSStringView {
+
+public:
+
+  JSStringView(const char* str): _data(str), _size(strlen(str)) {}
+
+  JSStringView(const std::string& str): _data(str.c_str()), _size(str.size()) {}
+
+  // Note: 'str[size]' must be 0
+  JSStringView(const char* str, size_t size): _data(str), _size(size) {}
+
+  const char* c_str() const {
+    return _data;
+  }
+
+  size_t size() const {
+    return _size;
+  }
+
+  std::string str() const {
+    return std::string(_data, _size);
+  }
+
+private:
+
+  const char* _data;
+  size_t _size;
+};
+
+/**
+ * Called by JSObject::forEach() once per property.
+ *
+ * Note: key and value are borrowed from the object, i.e., they are valid
+ *   only during the call.
+ */
+class JSPropertyVisitor {
+
+public:
+
+  virtual ~JSPropertyVisitor() {}
+
+  virtual void visit(const JSStringView& key, JSValue& value) = 0;
+};
+
+template <class F>
+class JSPropertyVisitorImpl: public JSPropertyVisitor {
+
+public:
+
+  JSPropertyVisitorImpl(F& f): f(f) {}
+
+  virtual void visit(const JSStringView& key, JSValue& value) {
+    f(key, value);
+  }
+
+private:
+
+  F& f;
+};
+
+/**
+ * A property name prepared once by a JSContext (see JSContext::newPropertyKey).
+ *
+ * The engine string behind a key is created and interned only once,
+ * so that repeated property access with the same name does not need to
+ * convert the name again. A key must only be used with objects of the
+ * context that created it.
+ */
+class JSPropertyKey {
+
+public:
+
+  virtual ~JSPropertyKey() {}
+
+  virtual std::string getName() = 0;
+};
+
 class JSObject: virtual public JSValue {
 
 public:
 
   virtual ~JSObject () {}
 
-  virtual JSValuePtr get(const std::string& key) = 0;
+  virtual JSValuePtr get(const JSStringView& key) = 0;
+
+  virtual void set(const JSStringView& key, JSValuePtr val) = 0;
 
-  virtual void set(const std::string& key, JSValuePtr val) = 0;
+  virtual void set(const JSStringView& key, const std::string& val) = 0;
 
-  virtual void set(const std::string& key, const std::string& val) = 0;
+  virtual void set(const JSStringView& key, const char* val) = 0;
 
-  virtual void set(const std::string& key, const char* val) = 0;
+  // Note: backends may take over the string instead of copying it
+  virtual void set(const JSStringView& key, std::string&& val) = 0;
 
-  virtual void set(const std::string& key, bool val) = 0;
+  virtual void set(const JSStringView& key, bool val) = 0;
 
-  virtual void set(const std::string& key, double val) = 0;
+  virtual void set(const JSStringView& key, double val) = 0;
 
   virtual StrVector getKeys() = 0;
 
-  inline void set(const std::string& key, JSArrayPtr val);
+  // Visits all properties in a single pass without copying the keys.
+  virtual void forEach(JSPropertyVisitor& visitor) = 0;
+
+  // E.g., obj->forEach([](const JSStringView& key, JSValue& value) { ... });
+  template <class F>
+  typename std::enable_if<!std::is_base_of<JSPropertyVisitor, F>::value>::type forEach(F f) {
+    JSPropertyVisitorImpl<F> visitor(f);
+    forEach(visitor);
+  }
+
+  virtual JSValuePtr get(const JSPropertyKeyPtr& key) = 0;
 
-  inline void set(const std::string& key, JSObjectPtr val);
+  virtual void set(const JSPropertyKeyPtr& key, JSValuePtr val) = 0;
+
+  virtual void set(const JSPropertyKeyPtr& key, const std::string& val) = 0;
+
+  virtual void set(const JSPropertyKeyPtr& key, const char* val) = 0;
+
+  virtual void set(const JSPropertyKeyPtr& key, bool val) = 0;
+
+  virtual void set(const JSPropertyKeyPtr& key, double val) = 0;
+
+  // Calls this object as a function (e.g., created with JSContext::newFunction()).
+  virtual JSValuePtr call(const std::vector<JSValuePtr>& args) = 0;
+
+  // Calls this function once per element of 'args' with (element, index)
+  // and stores the i-th result at index i of 'results',
+  // which has to be preallocated, e.g., with JSContext::newArray(length).
+  // Note: the loop runs inside the backend without wrapping values
+  virtual void callEach(JSArrayPtr args, JSArrayPtr results) = 0;
+
+  virtual void callEach(const std::vector<JSValuePtr>& args, JSArrayPtr results) = 0;
+
+  inline void set(const JSStringView& key, JSArrayPtr val);
+
+  inline void set(const JSStringView& key, JSObjectPtr val);
 
 };
 
@@ -120,10 +308,19 @@ public:
 
   virtual void setAt(unsigned int index, const char* val) = 0;
 
+  virtual void setAt(unsigned int index, std::string&& val) = 0;
+
   virtual void setAt(unsigned int index, bool val) = 0;
 
   virtual void setAt(unsigned int index, double val) = 0;
 
+  // Copies the elements [begin, begin+count) as numbers into 'result'.
+  // Elements which are not numbers are converted (NaN if not possible).
+  virtual void readDoubles(unsigned int begin, unsigned int count, double* result) = 0;
+
+  // Sets the elements [begin, begin+count) to the given numbers.
+  virtual void writeDoubles(unsigned int begin, unsigned int count, const double* values) = 0;
+
   inline void setAt(unsigned int index, JSArrayPtr val);
 
   inline void setAt(unsigned int index, JSObjectPtr val);
@@ -140,6 +337,8 @@ public:
 
   virtual JSValuePtr newString(const char* val) = 0;
 
+  virtual JSValuePtr newString(std::string&& val) = 0;
+
   virtual JSValuePtr newBoolean(bool val) = 0;
 
   virtual JSValuePtr newNumber(double val) = 0;
@@ -152,6 +351,11 @@ public:
 
   virtual JSValuePtr undefined() = 0;
 
+  virtual JSPropertyKeyPtr newPropertyKey(const std::string& key) = 0;
+
+  // Creates a function object which calls 'callback' when called from a script.
+  virtual JSObjectPtr newFunction(JSNativeCallbackPtr callback) = 0;
+
   virtual std::string toJson(JSValuePtr val) = 0;
 
   virtual JSValuePtr fromJson(const std::string& str) = 0;
@@ -191,11 +395,11 @@ bool JSValue::isArray() {
   return(getType() == JSValue::Array);
 }
 
-void JSObject::set(const std::string& key, JSArrayPtr val) {
+void JSObject::set(const JSStringView& key, JSArrayPtr val) {
   set(key, toValue(val));
 };
 
-void JSObject::set(const std::string& key, JSObjectPtr val) {
+void JSObject::set(const JSStringView& key, JSObjectPtr val) {
   set(key, toValue(val));
 };
 
@@ -207,24 +411,223 @@ void JSArray::setAt(unsigned int index, JSObjectPtr val) {
   setAt(index, toValue(val));
 };
 
-template <typename A>
+template <typename... Args>
 class JSVoidFunction {
 public:
-  typedef JSVoidFunction<A> _JSVoidFunction;
+  typedef JSVoidFunction<Args...> _JSVoidFunction;
   typedef JSOBJECTS_PTR_TYPE(_JSVoidFunction) Ptr;
 
-  virtual void call(A arg) = 0;
+  virtual ~JSVoidFunction() {}
+
+  virtual void call(Args... args) = 0;
 };
 
-template <typename R, typename A>
+template <typename R, typename... Args>
 class JSFunction {
 
 public:
-  typedef JSFunction<R,A> _JSFunctionType;
+  typedef JSFunction<R, Args...> _JSFunctionType;
   typedef JSOBJECTS_PTR_TYPE(_JSFunctionType) Ptr;
 
-  virtual R call(A arg) = 0;
+  virtual ~JSFunction() {}
+
+  virtual R call(Args... args) = 0;
+};
+
+// Stores a function pointer, lambda or functor as is,
+// i.e., a call costs exactly one virtual dispatch.
+template <typename F, typename R, typename... Args>
+class JSFunctionImpl: public JSFunction<R, Args...> {
+
+public:
+  JSFunctionImpl(const F& f): f(f) {}
+
+  virtual R call(Args... args) {
+    return f(args...);
+  }
+
+private:
+  F f;
+};
+
+template <typename F, typename... Args>
+class JSVoidFunctionImpl: public JSVoidFunction<Args...> {
+
+public:
+  JSVoidFunctionImpl(const F& f): f(f) {}
+
+  virtual void call(Args... args) {
+    f(args...);
+  }
+
+private:
+  F f;
+};
+
+/**
+ * Converts between C++ values and JSValues.
+ *
+ * Specialized for the types which can be used as arguments
+ * and results of native callbacks.
+ */
+template <typename T>
+struct JSValueConverter;
+
+template <>
+struct JSValueConverter<double> {
+  static double from(const JSValuePtr& val) { return val->asDouble(); }
+  static JSValuePtr to(JSContext& context, double val) { return context.newNumber(val); }
+};
+
+template <>
+struct JSValueConverter<int> {
+  static int from(const JSValuePtr& val) { return val->asInteger(); }
+  static JSValuePtr to(JSContext& context, int val) { return context.newNumber(val); }
+};
+
+template <>
+struct JSValueConverter<bool> {
+  static bool from(const JSValuePtr& val) { return val->asBool(); }
+  static JSValuePtr to(JSContext& context, bool val) { return context.newBoolean(val); }
+};
+
+template <>
+struct JSValueConverter<std::string> {
+  static std::string from(const JSValuePtr& val) { return val->asString(); }
+  static JSValuePtr to(JSContext& context, const std::string& val) { return context.newString(val); }
+};
+
+template <>
+struct JSValueConverter<const char*> {
+  static JSValuePtr to(JSContext& context, const char* val) { return context.newString(val); }
+};
+
+template <>
+struct JSValueConverter<JSValuePtr> {
+  static const JSValuePtr& from(const JSValuePtr& val) { return val; }
+  static JSValuePtr to(JSContext&, const JSValuePtr& val) { return val; }
+};
+
+template <>
+struct JSValueConverter<JSObjectPtr> {
+  static JSObjectPtr from(const JSValuePtr& val) { return val->asObject(); }
+  static JSValuePtr to(JSContext&, const JSObjectPtr& val) { return val->toValue(val); }
+};
+
+template <>
+struct JSValueConverter<JSArrayPtr> {
+  static JSArrayPtr from(const JSValuePtr& val) { return val->asArray(); }
+  static JSValuePtr to(JSContext&, const JSArrayPtr& val) { return val->toValue(val); }
+};
+
+/**
+ * A native function that can be called from scripts.
+ *
+ * The backends hand over all arguments at once; 'argv' holds 'argc' values.
+ * See CreateNativeCallback() for marshaling to a typed C++ function.
+ */
+class JSNativeCallback {
+
+public:
+
+  virtual ~JSNativeCallback() {}
+
+  virtual JSValuePtr invoke(JSContext& context, size_t argc, const JSValuePtr* argv) = 0;
+};
+
+template <size_t... I>
+struct JSIndices {};
+
+template <size_t N, size_t... I>
+struct JSMakeIndices: JSMakeIndices<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct JSMakeIndices<0, I...> {
+  typedef JSIndices<I...> type;
+};
+
+template <typename T>
+struct JSArgument {
+  typedef JSValueConverter<typename std::decay<T>::type> Converter;
+};
+
+template <typename R>
+struct JSNativeInvoke {
+  template <typename F, typename... Args, size_t... I>
+  static JSValuePtr apply(JSContext& context, F& f, const JSValuePtr* argv, JSIndices<I...>) {
+    return JSValueConverter<typename std::decay<R>::type>::to(context,
+      f(JSArgument<Args>::Converter::from(argv[I])...));
+  }
+};
+
+template <>
+struct JSNativeInvoke<void> {
+  template <typename F, typename... Args, size_t... I>
+  static JSValuePtr apply(JSContext& context, F& f, const JSValuePtr* argv, JSIndices<I...>) {
+    f(JSArgument<Args>::Converter::from(argv[I])...);
+    return context.undefined();
+  }
+};
+
+// Marshals the arguments to 'Args' and the result from 'R' at compile time.
+// Missing arguments are passed as undefined, extra arguments are ignored.
+template <typename F, typename R, typename... Args>
+class JSNativeCallbackImpl: public JSNativeCallback {
+
+public:
+
+  JSNativeCallbackImpl(const F& f): f(f) {}
+
+  virtual JSValuePtr invoke(JSContext& context, size_t argc, const JSValuePtr* argv) {
+    typedef typename JSMakeIndices<sizeof...(Args)>::type Indices;
+
+    if(argc < sizeof...(Args)) {
+      // Note: one extra slot, as arrays must not be empty
+      JSValuePtr padded[sizeof...(Args) + 1];
+      for(size_t idx = 0; idx < sizeof...(Args); ++idx) {
+        padded[idx] = (idx < argc) ? argv[idx] : context.undefined();
+      }
+      return JSNativeInvoke<R>::template apply<F, Args...>(context, f, padded, Indices());
+    }
+    return JSNativeInvoke<R>::template apply<F, Args...>(context, f, argv, Indices());
+  }
+
+private:
+  F f;
+};
+
+// Deduces result and argument types of functions, lambdas and functors.
+template <typename F>
+struct JSCallableTraits: JSCallableTraits<decltype(&F::operator())> {};
+
+template <typename R, typename... Args>
+struct JSCallableTraits<R (*)(Args...)> {
+  template <typename F>
+  static JSNativeCallback* create(const F& f) {
+    return new JSNativeCallbackImpl<F, R, Args...>(f);
+  }
 };
+
+template <typename C, typename R, typename... Args>
+struct JSCallableTraits<R (C::*)(Args...)>: JSCallableTraits<R (*)(Args...)> {};
+
+template <typename C, typename R, typename... Args>
+struct JSCallableTraits<R (C::*)(Args...) const>: JSCallableTraits<R (*)(Args...)> {};
+
+template <typename F>
+JSNativeCallbackPtr CreateNativeCallback(F f) {
+  return JSNativeCallbackPtr(JSCallableTraits<F>::create(f));
+}
+
+template <typename R, typename... Args>
+JSNativeCallbackPtr CreateNativeCallback(const boost::shared_ptr< JSFunction<R, Args...> >& f) {
+  return CreateNativeCallback([f](Args... args) { return f->call(args...); });
+}
+
+template <typename... Args>
+JSNativeCallbackPtr CreateNativeCallback(const boost::shared_ptr< JSVoidFunction<Args...> >& f) {
+  return CreateNativeCallback([f](Args... args) { f->call(args...); });
+}
   
 } // namespace jsobjects
 
@@ -0,0 +1,154 @@
+#ifndef JSOBJECTS_COMPARE_HPP
+#define JSOBJECTS_COMPARE_HPP
+
+#include "jsobjects.hpp"
+
+#include <algorithm>
+
+namespace jsobjects {
+
+// Building blocks of the structural hash; backends with direct access to
+// their storage (see JSValueCpp::hash()) use them to produce the same values.
+
+inline size_t JSHash_combine(size_t seed, size_t hash) {
+  return seed ^ (hash + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+// FNV-1a
+inline size_t JSHash_string(const char* str, size_t size) {
+  size_t hash = 2166136261u;
+  for(size_t idx = 0; idx < size; ++idx) {
+    hash = (hash ^ static_cast<unsigned char>(str[idx])) * 16777619u;
+  }
+  return hash;
+}
+
+// Note: 0 and -0 hash alike, as do all NaNs (see JSDeepEquals())
+inline size_t JSHash_number(double val) {
+  if(val != val) return 0x7ff80000u;
+  if(val == 0) val = 0;
+  return JSHash_string(reinterpret_cast<const char*>(&val), sizeof(val));
+}
+
+inline size_t JSHash_begin(JSValue::JSValueType type) {
+  return JSHash_combine(0, static_cast<size_t>(type) + 1);
+}
+
+// Object hashes do not depend on the order of the properties.
+inline size_t JSHash_property(const JSStringView& key, size_t valueHash) {
+  return JSHash_combine(JSHash_string(key.c_str(), key.size()), valueHash);
+}
+
+// Numbers are equal if they are the same number or both NaN.
+inline bool JSDeepEquals_number(double a, double b) {
+  return (a == b) || (a != a && b != b);
+}
+
+/**
+ * Structural hash of a value, i.e., values for which JSDeepEquals() holds
+ * have the same hash.
+ *
+ * Works with values of any backend; for JSValueCpp trees JSValueCpp::hash()
+ * computes the same value and can memoize it.
+ */
+inline size_t JSHash(JSValue& val) {
+  JSValue::JSValueType type = val.getType();
+  size_t hash = JSHash_begin(type);
+  switch(type) {
+  case JSValue::Null:
+  case JSValue::Undefined:
+    break;
+  case JSValue::Boolean:
+    hash = JSHash_combine(hash, val.asBool() ? 1 : 0);
+    break;
+  case JSValue::Number:
+    hash = JSHash_combine(hash, JSHash_number(val.asDouble()));
+    break;
+  case JSValue::String: {
+    std::string str;
+    val.asString(str);
+    hash = JSHash_combine(hash, JSHash_string(str.c_str(), str.size()));
+    break;
+  }
+  case JSValue::Array: {
+    JSArrayPtr arr = val.asArray();
+    unsigned int length = arr->length();
+    hash = JSHash_combine(hash, length);
+    for(unsigned int idx = 0; idx < length; ++idx) {
+      hash = JSHash_combine(hash, JSHash(*arr->getAt(idx)));
+    }
+    break;
+  }
+  case JSValue::Object: {
+    size_t properties = 0;
+    val.asObject()->forEach([&properties](const JSStringView& key, JSValue& value) {
+      properties += JSHash_property(key, JSHash(value));
+    });
+    hash = JSHash_combine(hash, properties);
+    break;
+  }
+  }
+  return hash;
+}
+
+/**
+ * Compares two values structurally.
+ *
+ * Objects are equal if they have the same keys with equal values, in any
+ * order; arrays if they have equal elements. Unlike in JavaScript, NaN
+ * equals NaN, so that a value always equals itself.
+ *
+ * Note: function objects are compared as plain objects.
+ */
+inline bool JSDeepEquals(JSValue& a, JSValue& b) {
+  JSValue::JSValueType type = a.getType();
+  if(type != b.getType()) return false;
+  switch(type) {
+  case JSValue::Null:
+  case JSValue::Undefined:
+    return true;
+  case JSValue::Boolean:
+    return a.asBool() == b.asBool();
+  case JSValue::Number:
+    return JSDeepEquals_number(a.asDouble(), b.asDouble());
+  case JSValue::String:
+    return a.asString() == b.asString();
+  case JSValue::Array: {
+    JSArrayPtr arrA = a.asArray();
+    JSArrayPtr arrB = b.asArray();
+    unsigned int length = arrA->length();
+    if(length != arrB->length()) return false;
+    for(unsigned int idx = 0; idx < length; ++idx) {
+      if(!JSDeepEquals(*arrA->getAt(idx), *arrB->getAt(idx))) return false;
+    }
+    return true;
+  }
+  case JSValue::Object: {
+    JSObjectPtr objA = a.asObject();
+    JSObjectPtr objB = b.asObject();
+    StrVector keysA = objA->getKeys();
+    StrVector keysB = objB->getKeys();
+    if(keysA.size() != keysB.size()) return false;
+    std::sort(keysA.begin(), keysA.end());
+    std::sort(keysB.begin(), keysB.end());
+    if(keysA != keysB) return false;
+    for(size_t idx = 0; idx < keysA.size(); ++idx) {
+      if(!JSDeepEquals(*objA->get(keysA[idx]), *objB->get(keysA[idx]))) return false;
+    }
+    return true;
+  }
+  }
+  return false;
+}
+
+inline size_t JSHash(const JSValuePtr& val) {
+  return JSHash(*val);
+}
+
+inline bool JSDeepEquals(const JSValuePtr& a, const JSValuePtr& b) {
+  return JSDeepEquals(*a, *b);
+}
+
+} // namespace jsobjects
+
+#endif // JSOBJECTS_COMPARE_HPP
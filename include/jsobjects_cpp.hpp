@@ -2,13 +2,34 @@
 #define JSOBJECTS_CPP_HPP
 
 #include <assert.h>
+#include <algorithm>
+#include <limits>
 #include <map>
+#include <stdexcept>
+#include <unordered_map>
 #include <vector>
 
+#include <boost/weak_ptr.hpp>
+
 #include "jsobjects.hpp"
+#include "jsobjects_static.hpp"
+#include "jsobjects_compare.hpp"
 
 namespace jsobjects {
 
+class JSInternerCpp;
+class JSFrozenValueCpp;
+class JSContextCpp;
+struct JSParallelCpp;
+
+// Thrown when a value can not be modified, e.g., as it is frozen (see JSValueCpp::freeze()).
+class JSValueErrorCpp: public std::runtime_error {
+
+public:
+
+  JSValueErrorCpp(const char* message): std::runtime_error(message) {}
+};
+
 class JSValueCpp: virtual public JSValue {
 
 protected:
@@ -17,19 +38,60 @@ protected:
 
   public:
 
+    _Data(): b(false), d(0), hash(0), hashType(Undefined), hashValid(false), frozen(false),
+      parent(0), borrowing(false) {}
+
+    inline ~_Data();
+
     std::string str;
     bool b;
     double d;
     std::map<std::string, JSValuePtr> map;
     std::vector<JSValuePtr> vector;
+    // set for function objects
+    JSNativeCallbackPtr callback;
+    // structural hash of frozen nodes, memoized by freeze() (see JSValueCpp::hash())
+    size_t hash;
+    JSValueType hashType;
+    bool hashValid;
+    // set for values which must not be modified anymore, e.g., shared by a JSInternerCpp
+    bool frozen;
+    // The links which let modifications copy what clones share (see JSValueCpp::clone()):
+    // the node this one has been stored in first (0 for roots and frozen nodes),
+    _Data* parent;
+    // the clones which refer to this node as one of their children (they
+    // unregister when they drop it or are destroyed, see _Release()),
+    std::vector<_Data*> borrowers;
+    // the node this one has been copied from,
+    boost::weak_ptr<_Data> origin;
+    // and whether this node may refer to children of another one.
+    bool borrowing;
+    // the properties of frozen objects in key order (see JSFrozenValueCpp::get())
+    std::vector<const std::pair<const std::string, JSValuePtr>*> index;
   };
 
   typedef boost::shared_ptr<_Data> DataPtr;
 
+  // The position a child has been read from, if it is borrowed by a clone (see _Child()).
+  struct _Step {
+    // the child as it has been read
+    DataPtr value;
+    // the node it has been read from, unless that node is borrowed itself
+    DataPtr container;
+    boost::shared_ptr<_Step> up;
+    bool indexed;
+    std::string key;
+    unsigned int index;
+  };
+
+  typedef boost::shared_ptr<_Step> StepPtr;
+
   JSValueCpp(): data(new _Data()) { }
 
   JSValueCpp(JSValueType type): type(type), data(new _Data()) { }
 
+  JSValueCpp(JSValueType type, DataPtr data): type(type), data(data) { }
+
 public:
 
   JSValueCpp(const std::string& val): data(new _Data()) {
@@ -37,6 +99,11 @@ public:
       data->str = val;
   }
 
+  JSValueCpp(std::string&& val): data(new _Data()) {
+    type = String;
+    data->str = std::move(val);
+  }
+
   JSValueCpp(const char* val): data(new _Data()) {
     type = String;
     data->str = val;
@@ -62,6 +129,11 @@ public:
     return data->str;
   }
 
+  virtual void asString(std::string& result) {
+    assert(type == String);
+    result = data->str;
+  }
+
   virtual  double asDouble() {
     assert(type == Number);
     return data->d;
@@ -77,6 +149,48 @@ public:
 
   virtual inline JSValuePtr toValue(JSObjectPtr obj);
 
+  virtual void* getImpl() {
+    return this;
+  }
+
+  bool isFrozen() {
+    _Sync();
+    return data->frozen;
+  }
+
+  // Makes this value and all its children immutable, i.e., modifying them
+  // throws afterwards. Frozen values are never written, not even by reads,
+  // so that they can be shared by threads (see JSFrozenValueCpp).
+  inline void freeze();
+
+  // Creates a copy which can be modified independently of this value.
+  //
+  // Copy-on-write: only this node is copied; its children are borrowed,
+  // i.e., shared with this value. Modifying the clone copies the path to
+  // the modified node into the clone first, and modifying this value
+  // (also through references obtained before) gives the clone copies of
+  // what it has borrowed. Reading copies nothing. Frozen values are cloned
+  // the same way, i.e., clones of frozen values can be modified.
+  //
+  // Note: a node which is stored in several nodes is kept apart from
+  //   clones only along the node it has been stored in first
+  // Note: a reference to a borrowed child of a clone which has been
+  //   replaced or moved in the clone since can be read, but not modified
+  inline JSValuePtr clone();
+
+  // Structural hash, the same as JSHash() (see jsobjects_compare.hpp).
+  // With 'memoize', the hashes of frozen subtrees are reused; freeze()
+  // memoizes them. Mutable nodes are always hashed in full, as any of their
+  // children may have been modified through an outside reference.
+  // E.g., to hash variants of a large document in O(changed), freeze the
+  // document and hash clones of it (see clone()).
+  inline size_t hash(bool memoize = false);
+
+  // Structural comparison, the same as JSDeepEquals(). Subtrees shared by
+  // both sides are not visited, and frozen subtrees whose memoized hashes
+  // differ end the comparison early.
+  inline bool deepEquals(JSValueCpp& other);
+
   virtual  bool asBool() {
     assert(type == Boolean);
     return data->b;
@@ -98,8 +212,141 @@ public:
 
 protected:
 
+  // Called before a node is modified: a borrowed node is copied into the
+  // clone it has been read from, and clones which borrow this node (or the
+  // nodes it is stored in) get their own copies (see clone()).
+  void _Modify() {
+    if(step) {
+      DataPtr own = _Claim(*step);
+      if(!own) throw JSValueErrorCpp("Value has been replaced");
+      data = own;
+      step.reset();
+    }
+    if(data->frozen) throw JSValueErrorCpp("Value is frozen");
+    _Unshare(data.get());
+  }
+
+  // Called before a node is read: a borrowed node follows its position,
+  // e.g., to the copy which the clone has made of it since.
+  // Note: only borrowed nodes look up their positions, i.e., reading
+  //   other nodes costs nothing
+  void _Sync() {
+    if(step) _Follow();
+  }
+
+  inline void _Follow();
+
+  // The child at a position, and the node it is stored in; 0 if it is gone.
+  static inline JSValuePtr* _Locate(const _Step& position, _Data*& container);
+
+  static inline JSValuePtr* _Slot(_Data* container, const _Step& position);
+
+  // Freezes this node only; its children must be frozen already.
+  inline void _Freeze();
+
+  // A child as handed out by get() and getAt(): a borrowed child (see
+  // clone()) is handed out with its position, so that modifying it copies
+  // it into this node first.
+  JSValuePtr _Child(const JSValuePtr& child, const std::string* key, unsigned int index) {
+    if(!_Borrows(child)) return child;
+    JSValueCpp* node = _Impl(child);
+    StepPtr position(new _Step());
+    position->value = node->data;
+    if(step) {
+      // Note: the children of a borrowed node are borrowed, too
+      position->up = step;
+    } else {
+      position->container = data;
+    }
+    position->indexed = (key == 0);
+    if(key != 0) position->key = *key;
+    position->index = index;
+    JSValuePtr result = _Wrap(node->type, node->data);
+    _Impl(result)->step = position;
+    return result;
+  }
+
+  // Whether a child of this node is borrowed from another one.
+  bool _Borrows(const JSValuePtr& child) {
+    JSValueCpp* node = _Impl(child);
+    if(node == 0 || (node->type != Array && node->type != Object)) return false;
+    return step || _Borrowed(data.get(), node->data.get());
+  }
+
+  // Replaces a child of this node by 'val'.
+  void _Store(JSValuePtr& child, const JSValuePtr& val) {
+    if(child) _Release(data.get(), child);
+    child = _Adopt(data.get(), val);
+  }
+
+  static bool _Borrowed(const _Data* container, const _Data* child) {
+    // Note: frozen nodes are never written, i.e., every mutable node borrows them
+    if(child->frozen) return !container->frozen;
+    return std::find(child->borrowers.begin(), child->borrowers.end(), container) != child->borrowers.end();
+  }
+
+  // A copy of a node which borrows the children of the node.
+  static inline DataPtr _Copy(const DataPtr& node);
+
+  // Called before a node is modified in place: the clones which borrow it,
+  // or one of the nodes it is stored in, get copies of them as they are.
+  static inline void _Unshare(_Data* node);
+
+  static inline void _Snapshot(_Data* borrower, _Data* node, JSValuePtr& child, DataPtr& copy);
+
+  // The node at a position as owned by the node it is stored in, i.e., copies
+  // the borrowed nodes along the position; 0 if the node has been replaced.
+  static inline DataPtr _Claim(const _Step& position);
+
+  // Replaces a borrowed child of 'container' by a copy owned by it.
+  static inline DataPtr _Own(_Data* container, JSValuePtr& child);
+
+  // The child to store in 'container' for 'val'.
+  static inline JSValuePtr _Adopt(_Data* container, const JSValuePtr& val);
+
+  // Unlinks a child which is removed from 'container'.
+  static inline void _Release(_Data* container, const JSValuePtr& child);
+
+  static void _Lend(_Data* container, const JSValuePtr& child) {
+    JSValueCpp* node = _Impl(child);
+    if(node != 0 && (node->type == Array || node->type == Object) && !node->data->frozen) {
+      node->data->borrowers.push_back(container);
+    }
+  }
+
+  static inline JSValuePtr _Wrap(JSValueType type, const DataPtr& data);
+
+  // Note: 0 for empty pointers, which arrays and objects may hold
+  static JSValueCpp* _Impl(const JSValuePtr& val) {
+    return val ? static_cast<JSValueCpp*>(val->getImpl()) : 0;
+  }
+
+  // Hashes and compares children, where empty pointers count as undefined.
+  static inline size_t _Hash(const JSValuePtr& child, bool memoize);
+
+  static inline bool _Equals(const JSValuePtr& a, const JSValuePtr& b);
+
   JSValueType type;
   DataPtr data;
+  // set for borrowed nodes handed out by get() and getAt() (see _Child())
+  StepPtr step;
+
+  friend class JSInternerCpp;
+  friend class JSFrozenValueCpp;
+  friend struct JSParallelCpp;
+};
+
+class JSPropertyKeyCpp: public JSPropertyKey {
+
+public:
+
+  JSPropertyKeyCpp(const std::string& key): key(key) {}
+
+  virtual std::string getName() {
+    return key;
+  }
+
+  std::string key;
 };
 
 class JSObjectCpp: public JSValueCpp, virtual public JSObject {
@@ -108,35 +355,52 @@ public:
 
   JSObjectCpp(): JSValueCpp(Object) { }
 
-  JSObjectCpp(DataPtr data): JSValueCpp(Object) {
-    this->data = data;
+  JSObjectCpp(DataPtr data): JSValueCpp(Object, data) { }
+
+  // Creates a function object.
+  explicit JSObjectCpp(JSNativeCallbackPtr callback): JSValueCpp(Object) {
+    data->callback = callback;
   }
 
-  virtual JSValuePtr get(const std::string& key) {
-    return data->map[key];
+  virtual JSValuePtr get(const JSStringView& key) {
+    _Sync();
+    std::map<std::string, JSValuePtr>::iterator it = data->map.find(_key(key));
+    if(it == data->map.end()) return JSValuePtr();
+    return _Child(it->second, &it->first, 0);
   }
 
-  virtual void set(const std::string& key, JSValuePtr val) {
-    data->map[key] = val;
+  virtual void set(const JSStringView& key, JSValuePtr val) {
+    _Modify();
+    _Store(data->map[_key(key)], val);
   }
 
-  virtual void set(const std::string& key, const std::string& val) {
-    data->map[key] = JSValuePtr(new JSValueCpp(val));
+  virtual void set(const JSStringView& key, const std::string& val) {
+    _Modify();
+    _Store(data->map[_key(key)], JSValuePtr(new JSValueCpp(val)));
   }
 
-  virtual void set(const std::string& key, const char* val) {
-    data->map[key] = JSValuePtr(new JSValueCpp(std::string(val)));
+  virtual void set(const JSStringView& key, const char* val) {
+    _Modify();
+    _Store(data->map[_key(key)], JSValuePtr(new JSValueCpp(std::string(val))));
   }
 
-  virtual void set(const std::string& key, bool val) {
-    data->map[key] = JSValuePtr(new JSValueCpp(val));
+  virtual void set(const JSStringView& key, std::string&& val) {
+    _Modify();
+    _Store(data->map[_key(key)], JSValuePtr(new JSValueCpp(std::move(val))));
   }
 
-  virtual void set(const std::string& key, double val) {
-    data->map[key] = JSValuePtr(new JSValueCpp(val));
+  virtual void set(const JSStringView& key, bool val) {
+    _Modify();
+    _Store(data->map[_key(key)], JSValuePtr(new JSValueCpp(val)));
+  }
+
+  virtual void set(const JSStringView& key, double val) {
+    _Modify();
+    _Store(data->map[_key(key)], JSValuePtr(new JSValueCpp(val)));
   }
 
   virtual StrVector getKeys() {
+    _Sync();
     StrVector keys;
     for(std::map<std::string, JSValuePtr>::iterator it = data->map.begin();
 	it != data->map.end(); ++it) {
@@ -145,6 +409,65 @@ public:
     return keys;
   }
 
+  virtual void forEach(JSPropertyVisitor& visitor) {
+    _Sync();
+    for(std::map<std::string, JSValuePtr>::iterator it = data->map.begin();
+        it != data->map.end(); ++it) {
+      if(!_Borrows(it->second)) {
+        visitor.visit(JSStringView(it->first), *it->second);
+        continue;
+      }
+      JSValuePtr val = _Child(it->second, &it->first, 0);
+      visitor.visit(JSStringView(it->first), *val);
+    }
+  }
+
+  virtual JSValuePtr get(const JSPropertyKeyPtr& key) {
+    return get(_key(key));
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, JSValuePtr val) {
+    set(_key(key), val);
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, const std::string& val) {
+    set(_key(key), val);
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, const char* val) {
+    set(_key(key), val);
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, bool val) {
+    set(_key(key), val);
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, double val) {
+    set(_key(key), val);
+  }
+
+  inline virtual JSValuePtr call(const std::vector<JSValuePtr>& args);
+
+  inline virtual void callEach(JSArrayPtr args, JSArrayPtr results);
+
+  inline virtual void callEach(const std::vector<JSValuePtr>& args, JSArrayPtr results);
+
+protected:
+
+  static const std::string& _key(const JSPropertyKeyPtr& key) {
+    return static_cast<JSPropertyKeyCpp*>(JSOBJECTS_PTR_GET(key))->key;
+  }
+
+  // Note: std::map can not be searched by other key types (before C++14);
+  //   a string per call keeps nested calls from overwriting each other's keys
+  static std::string _key(const JSStringView& key) {
+    return std::string(key.c_str(), key.size());
+  }
+
+  // The context passed to native callbacks; it is stateless and shared so
+  // that calls do not allocate one each time
+  static inline JSContextCpp& _Context();
+
 };
 
 class JSArrayCpp: public JSObjectCpp, virtual public JSArray {
@@ -159,38 +482,66 @@ public:
     }
   }
 
-  JSArrayCpp(DataPtr data) {
+  JSArrayCpp(DataPtr data): JSObjectCpp(data) {
     type = Array;
-    this->data = data;
   }
 
   virtual JSValuePtr getAt(unsigned int index) {
-    return data->vector[index];
+    _Sync();
+    return _Child(data->vector[index], 0, index);
   }
 
   virtual void setAt(unsigned int index, JSValuePtr val) {
-    data->vector[index] = val;
+    _Modify();
+    _Store(data->vector[index], val);
   };
 
   virtual void setAt(unsigned int index, const std::string& val) {
-    data->vector[index] = JSValuePtr(new JSValueCpp(val));
+    _Modify();
+    _Store(data->vector[index], JSValuePtr(new JSValueCpp(val)));
   }
 
   virtual void setAt(unsigned int index, const char* val) {
-    data->vector[index] = JSValuePtr(new JSValueCpp(std::string(val)));
+    _Modify();
+    _Store(data->vector[index], JSValuePtr(new JSValueCpp(std::string(val))));
+  }
+
+  virtual void setAt(unsigned int index, std::string&& val) {
+    _Modify();
+    _Store(data->vector[index], JSValuePtr(new JSValueCpp(std::move(val))));
   }
 
   virtual void setAt(unsigned int index, bool val) {
-    data->vector[index] = JSValuePtr(new JSValueCpp(val));
+    _Modify();
+    _Store(data->vector[index], JSValuePtr(new JSValueCpp(val)));
   }
 
   virtual void setAt(unsigned int index, double val) {
-    data->vector[index] = JSValuePtr(new JSValueCpp(val));
+    _Modify();
+    _Store(data->vector[index], JSValuePtr(new JSValueCpp(val)));
   }
 
   virtual unsigned int length() {
+    _Sync();
     return data->vector.size();
   }
+
+  virtual void readDoubles(unsigned int begin, unsigned int count, double* result) {
+    _Sync();
+    assert(begin + count <= data->vector.size());
+    for(unsigned int idx = 0; idx < count; ++idx) {
+      JSValuePtr val = data->vector[begin + idx];
+      result[idx] = (val && val->getType() == Number) ? val->asDouble() : std::numeric_limits<double>::quiet_NaN();
+    }
+  }
+
+  virtual void writeDoubles(unsigned int begin, unsigned int count, const double* values) {
+    _Modify();
+    assert(begin + count <= data->vector.size());
+    for(unsigned int idx = 0; idx < count; ++idx) {
+      _Store(data->vector[begin + idx], JSValuePtr(new JSValueCpp(values[idx])));
+    }
+  }
 };
 
 class JSContextCpp : public JSContext {
@@ -212,6 +563,10 @@ public:
     return JSValuePtr(new JSValueCpp(val));
   }
 
+  virtual JSValuePtr newString(std::string&& val) {
+    return JSValuePtr(new JSValueCpp(std::move(val)));
+  }
+
   virtual JSValuePtr newBoolean(bool val) {
     return JSValuePtr(new JSValueCpp(val));
   }
@@ -236,6 +591,14 @@ public:
     return _undefined;
   }
 
+  virtual JSPropertyKeyPtr newPropertyKey(const std::string& key) {
+    return JSPropertyKeyPtr(new JSPropertyKeyCpp(key));
+  }
+
+  virtual JSObjectPtr newFunction(JSNativeCallbackPtr callback) {
+    return JSObjectPtr(new JSObjectCpp(callback));
+  }
+
   JSObjectPtr newObject(const std::map<std::string, JSValuePtr> &vals) {
     JSObjectPtr obj(new JSObjectCpp());
     for(std::map<std::string, JSValuePtr>::const_iterator it = vals.begin();
@@ -257,6 +620,10 @@ public:
 
   virtual JSValuePtr fromJson(const std::string& str);
 
+  // Parses 'str' sharing equal values (see JSInternerCpp) as they are read,
+  // i.e., repeated values are never allocated more than once.
+  JSValuePtr fromJson(const std::string& str, JSInternerCpp& interner);
+
 private:
 
   JSValuePtr _null;
@@ -264,66 +631,595 @@ private:
   JSValuePtr _undefined;
 };
 
+JSContextCpp& JSObjectCpp::_Context() {
+  static JSContextCpp context;
+  return context;
+}
+
+JSValuePtr JSObjectCpp::call(const std::vector<JSValuePtr>& args) {
+  if(!data->callback) throw "Not a function";
+  JSContextCpp& context = _Context();
+  return data->callback->invoke(context, args.size(), args.empty() ? 0 : &args[0]);
+}
+
+void JSObjectCpp::callEach(JSArrayPtr args, JSArrayPtr results) {
+  if(!data->callback) throw "Not a function";
+  JSContextCpp& context = _Context();
+  unsigned int length = args->length();
+  assert(results->length() >= length);
+  JSValuePtr argv[2];
+  for(unsigned int idx = 0; idx < length; ++idx) {
+    argv[0] = args->getAt(idx);
+    argv[1] = context.newNumber(idx);
+    results->setAt(idx, data->callback->invoke(context, 2, argv));
+  }
+}
+
+void JSObjectCpp::callEach(const std::vector<JSValuePtr>& args, JSArrayPtr results) {
+  if(!data->callback) throw "Not a function";
+  JSContextCpp& context = _Context();
+  assert(results->length() >= args.size());
+  JSValuePtr argv[2];
+  for(size_t idx = 0; idx < args.size(); ++idx) {
+    argv[0] = args[idx];
+    argv[1] = context.newNumber(idx);
+    results->setAt(idx, data->callback->invoke(context, 2, argv));
+  }
+}
+
+/**
+ * Shares structurally equal values of JSValueCpp trees (hash-consing).
+ *
+ * intern() returns for each subtree and string the first equal one which
+ * has been interned before, so that repeated parts of documents are kept
+ * in memory only once:
+ *
+ *     JSInternerCpp interner;
+ *     val = interner.intern(val);
+ *
+ * As they may be shared, interned values are frozen, i.e., modifying them
+ * throws. The interner keeps all interned values alive until it is cleared.
+ *
+ * Note: object keys are not shared, as each object owns its keys.
+ */
+class JSInternerCpp {
+
+public:
+
+  // Note: modifies 'val' in place, i.e., replaces its children by shared ones
+  JSValuePtr intern(const JSValuePtr& val) {
+    JSValueCpp* node = JSValueCpp::_Impl(val);
+    if(node == 0) return val;
+    switch(node->type) {
+    case JSValue::Null:
+    case JSValue::Undefined:
+      return val;
+    default:
+      break;
+    }
+    // Note: frozen values have been interned before (possibly elsewhere)
+    if(!node->isFrozen()) {
+      node->_Modify();
+      _InternChildren(*node);
+      node->_Freeze();
+    }
+
+    size_t hash = node->hash(true);
+    std::pair<Table::iterator, Table::iterator> range = table.equal_range(hash);
+    for(Table::iterator it = range.first; it != range.second; ++it) {
+      // Note: as the children are shared, they are mostly compared by identity
+      if(JSValueCpp::_Impl(it->second)->deepEquals(*node)) return it->second;
+    }
+    table.insert(std::make_pair(hash, val));
+    return val;
+  }
+
+  // The number of distinct values.
+  size_t size() const {
+    return table.size();
+  }
+
+  void clear() {
+    table.clear();
+  }
+
+private:
+
+  typedef std::unordered_multimap<size_t, JSValuePtr> Table;
+
+  void _InternChildren(JSValueCpp& node) {
+    for(std::vector<JSValuePtr>::iterator it = node.data->vector.begin();
+        it != node.data->vector.end(); ++it) {
+      _InternChild(node, *it);
+    }
+    for(std::map<std::string, JSValuePtr>::iterator it = node.data->map.begin();
+        it != node.data->map.end(); ++it) {
+      _InternChild(node, it->second);
+    }
+  }
+
+  void _InternChild(JSValueCpp& node, JSValuePtr& child) {
+    // Note: borrowed children are copied, as the nodes they are borrowed from stay mutable
+    if(!child) return;
+    if(!JSValueCpp::_Impl(child)->data->frozen) JSValueCpp::_Own(node.data.get(), child);
+    JSValuePtr interned = intern(child);
+    if(interned != child) {
+      JSValueCpp::_Release(node.data.get(), child);
+      child = interned;
+    }
+  }
+
+  Table table;
+};
+
+/**
+ * Read-only access to a frozen JSValueCpp tree (see JSValueCpp::freeze()).
+ *
+ * Frozen trees are never written, so that any number of threads can read
+ * one concurrently without locks. This view reads the nodes directly,
+ * i.e., unlike get() and getAt(), it neither allocates nor touches
+ * reference counts, which would be contended by all threads:
+ *
+ *     doc->freeze();
+ *     // from any thread
+ *     JSFrozenValueCpp root(doc);
+ *     double timeout = root.get("server").get("timeout").asDouble();
+ *
+ * Missing properties are read as undefined.
+ *
+ * Note: the view does not keep the tree alive, and the tree must have been
+ *   frozen before it is passed to the reading threads.
+ */
+class JSFrozenValueCpp {
+
+public:
+
+  JSFrozenValueCpp(const JSValuePtr& val): node(JSValueCpp::_Impl(val)) {
+    assert(node == 0 || node->data->frozen || node->type == JSValue::Null || node->type == JSValue::Undefined);
+  }
+
+  JSValue::JSValueType getType() const {
+    return (node != 0) ? node->type : JSValue::Undefined;
+  }
+
+  bool isUndefined() const {
+    return getType() == JSValue::Undefined;
+  }
+
+  double asDouble() const {
+    assert(getType() == JSValue::Number);
+    return node->data->d;
+  }
+
+  bool asBool() const {
+    assert(getType() == JSValue::Boolean);
+    return node->data->b;
+  }
+
+  const std::string& asString() const {
+    assert(getType() == JSValue::String);
+    return node->data->str;
+  }
+
+  unsigned int length() const {
+    assert(getType() == JSValue::Array);
+    return node->data->vector.size();
+  }
+
+  JSFrozenValueCpp getAt(unsigned int index) const {
+    assert(index < length());
+    return JSFrozenValueCpp(JSValueCpp::_Impl(node->data->vector[index]));
+  }
+
+  JSFrozenValueCpp get(const JSStringView& key) const {
+    assert(getType() == JSValue::Object);
+    const Index& index = node->data->index;
+    Index::const_iterator it = std::lower_bound(index.begin(), index.end(), key,
+      [](const Index::value_type& entry, const JSStringView& key) {
+        return entry->first.compare(0, std::string::npos, key.c_str(), key.size()) < 0;
+      });
+    if(it == index.end() || (*it)->first.compare(0, std::string::npos, key.c_str(), key.size()) != 0) {
+      return JSFrozenValueCpp(0);
+    }
+    return JSFrozenValueCpp(JSValueCpp::_Impl((*it)->second));
+  }
+
+  // Calls f(const JSStringView& key, JSFrozenValueCpp value) for each property in key order.
+  template <class F>
+  void forEach(F f) const {
+    assert(getType() == JSValue::Object);
+    const Index& index = node->data->index;
+    for(Index::const_iterator it = index.begin(); it != index.end(); ++it) {
+      f(JSStringView((*it)->first), JSFrozenValueCpp(JSValueCpp::_Impl((*it)->second)));
+    }
+  }
+
+private:
+
+  typedef std::vector<const std::pair<const std::string, JSValuePtr>*> Index;
+
+  explicit JSFrozenValueCpp(JSValueCpp* node): node(node) {}
+
+  // 0 for missing properties
+  JSValueCpp* node;
+};
+
+JSValueCpp::_Data::~_Data() {
+  for(std::vector<JSValuePtr>::iterator it = vector.begin(); it != vector.end(); ++it) {
+    _Release(this, *it);
+  }
+  for(std::map<std::string, JSValuePtr>::iterator it = map.begin(); it != map.end(); ++it) {
+    _Release(this, it->second);
+  }
+}
+
+void JSValueCpp::freeze() {
+  // Note: null and undefined are never modified, and are shared by all threads as they are
+  if(type == Null || type == Undefined || isFrozen()) return;
+  // Note: borrowed nodes are copied, as the nodes they are borrowed from stay mutable
+  if(step) _Modify();
+  for(std::vector<JSValuePtr>::iterator it = data->vector.begin();
+      it != data->vector.end(); ++it) {
+    if(!*it || _Impl(*it)->data->frozen) continue;
+    _Own(data.get(), *it);
+    _Impl(*it)->freeze();
+  }
+  for(std::map<std::string, JSValuePtr>::iterator it = data->map.begin();
+      it != data->map.end(); ++it) {
+    if(!it->second || _Impl(it->second)->data->frozen) continue;
+    _Own(data.get(), it->second);
+    _Impl(it->second)->freeze();
+  }
+  _Freeze();
+}
+
+void JSValueCpp::_Freeze() {
+  if(type == Null || type == Undefined) return;
+  // Note: the children are frozen already, i.e., their memoized hashes are reused
+  data->hash = hash(true);
+  data->hashType = type;
+  data->hashValid = true;
+  data->index.clear();
+  for(std::map<std::string, JSValuePtr>::iterator it = data->map.begin();
+      it != data->map.end(); ++it) {
+    data->index.push_back(&*it);
+  }
+  // Note: frozen nodes are borrowed by all nodes they are stored in (see _Borrowed())
+  data->parent = 0;
+  data->borrowers.clear();
+  data->frozen = true;
+}
+
+JSValuePtr JSValueCpp::clone() {
+  _Sync();
+  if(type != Array && type != Object) {
+    // Note: other values can not be modified
+    return JSValuePtr(new JSValueCpp(type, data));
+  }
+  return _Wrap(type, _Copy(data));
+}
+
+void JSValueCpp::_Follow() {
+  _Data* container = 0;
+  JSValuePtr* slot = _Locate(*step, container);
+  if(slot != 0 && *slot) {
+    const DataPtr& current = _Impl(*slot)->data;
+    if(current == data) return;
+    if(current->origin.lock() == step->value) {
+      data = current;
+      if(!_Borrowed(container, current.get())) step.reset();
+      return;
+    }
+  }
+  // Note: the node has been replaced, i.e., it keeps what it has borrowed
+  step->container.reset();
+  step->up.reset();
+}
+
+JSValuePtr* JSValueCpp::_Locate(const _Step& position, _Data*& container) {
+  if(position.up) {
+    JSValuePtr* slot = _Locate(*position.up, container);
+    if(slot == 0 || !*slot) return 0;
+    container = _Impl(*slot)->data.get();
+  } else if(position.container) {
+    container = position.container.get();
+  } else {
+    return 0;
+  }
+  return _Slot(container, position);
+}
+
+JSValuePtr* JSValueCpp::_Slot(_Data* container, const _Step& position) {
+  if(position.indexed) {
+    return (position.index < container->vector.size()) ? &container->vector[position.index] : 0;
+  }
+  std::map<std::string, JSValuePtr>::iterator it = container->map.find(position.key);
+  return (it != container->map.end()) ? &it->second : 0;
+}
+
+JSValueCpp::DataPtr JSValueCpp::_Copy(const DataPtr& node) {
+  DataPtr copy(new _Data(*node));
+  copy->frozen = false;
+  copy->hashValid = false;
+  copy->index.clear();
+  copy->parent = 0;
+  copy->borrowers.clear();
+  copy->origin = node;
+  copy->borrowing = true;
+  for(std::vector<JSValuePtr>::iterator it = copy->vector.begin();
+      it != copy->vector.end(); ++it) {
+    _Lend(copy.get(), *it);
+  }
+  for(std::map<std::string, JSValuePtr>::iterator it = copy->map.begin();
+      it != copy->map.end(); ++it) {
+    _Lend(copy.get(), it->second);
+  }
+  return copy;
+}
+
+void JSValueCpp::_Unshare(_Data* node) {
+  // Note: top-down, i.e., the copies made for the nodes above borrow this node, too
+  if(node->parent != 0) _Unshare(node->parent);
+  if(node->borrowers.empty()) return;
+  std::vector<_Data*> borrowers;
+  borrowers.swap(node->borrowers);
+  std::sort(borrowers.begin(), borrowers.end());
+  borrowers.erase(std::unique(borrowers.begin(), borrowers.end()), borrowers.end());
+  for(std::vector<_Data*>::iterator borrower = borrowers.begin(); borrower != borrowers.end(); ++borrower) {
+    // Note: the borrower keeps a copy of this node as it is, under all its keys
+    DataPtr copy;
+    for(std::vector<JSValuePtr>::iterator it = (*borrower)->vector.begin();
+        it != (*borrower)->vector.end(); ++it) {
+      _Snapshot(*borrower, node, *it, copy);
+    }
+    for(std::map<std::string, JSValuePtr>::iterator it = (*borrower)->map.begin();
+        it != (*borrower)->map.end(); ++it) {
+      _Snapshot(*borrower, node, it->second, copy);
+    }
+  }
+}
+
+void JSValueCpp::_Snapshot(_Data* borrower, _Data* node, JSValuePtr& child, DataPtr& copy) {
+  JSValueCpp* impl = _Impl(child);
+  if(impl == 0 || impl->data.get() != node) return;
+  if(!copy) {
+    copy = _Copy(impl->data);
+    copy->parent = borrower;
+  }
+  child = _Wrap(impl->type, copy);
+}
+
+JSValueCpp::DataPtr JSValueCpp::_Claim(const _Step& position) {
+  DataPtr container;
+  if(position.up) {
+    container = _Claim(*position.up);
+  } else if(position.container) {
+    container = position.container;
+    _Unshare(container.get());
+  }
+  if(!container) return DataPtr();
+  JSValuePtr* slot = _Slot(container.get(), position);
+  if(slot == 0 || !*slot) return DataPtr();
+  const DataPtr& current = _Impl(*slot)->data;
+  if(current != position.value && current->origin.lock() != position.value) return DataPtr();
+  return _Own(container.get(), *slot);
+}
+
+JSValueCpp::DataPtr JSValueCpp::_Own(_Data* container, JSValuePtr& child) {
+  JSValueCpp* node = _Impl(child);
+  if(node == 0) return DataPtr();
+  if(node->type != Array && node->type != Object) return node->data;
+  if(!_Borrowed(container, node->data.get())) return node->data;
+  DataPtr borrowed = node->data;
+  _Release(container, child);
+  DataPtr copy = _Copy(borrowed);
+  copy->parent = container;
+  child = _Wrap(node->type, copy);
+  return copy;
+}
+
+JSValuePtr JSValueCpp::_Adopt(_Data* container, const JSValuePtr& val) {
+  JSValueCpp* node = _Impl(val);
+  if(node == 0 || (node->type != Array && node->type != Object)) return val;
+  node->_Sync();
+  if(node->step) {
+    // Note: a borrowed node is borrowed by 'container', too
+    _Lend(container, val);
+    container->borrowing = true;
+    return _Wrap(node->type, node->data);
+  }
+  if(!node->data->frozen && node->data->parent == 0) {
+    node->data->parent = container;
+  }
+  return val;
+}
+
+void JSValueCpp::_Release(_Data* container, const JSValuePtr& child) {
+  JSValueCpp* node = _Impl(child);
+  if(node == 0 || (node->type != Array && node->type != Object)) return;
+  _Data* released = node->data.get();
+  if(released->frozen) return;
+  std::vector<_Data*>::iterator it = std::find(released->borrowers.begin(), released->borrowers.end(), container);
+  if(it != released->borrowers.end()) {
+    released->borrowers.erase(it);
+  } else if(released->parent == container) {
+    released->parent = 0;
+  }
+}
+
+JSValuePtr JSValueCpp::_Wrap(JSValueType type, const DataPtr& data) {
+  if(type == Array) {
+    return JSValuePtr(new JSArrayCpp(data));
+  }
+  return JSValuePtr(new JSObjectCpp(data));
+}
+
+size_t JSValueCpp::hash(bool memoize) {
+  _Sync();
+  size_t result = JSHash_begin(type);
+  switch(type) {
+  case Null:
+  case Undefined:
+    return result;
+  case Boolean:
+    return JSHash_combine(result, data->b ? 1 : 0);
+  case Number:
+    return JSHash_combine(result, JSHash_number(data->d));
+  case String:
+    return JSHash_combine(result, JSHash_string(data->str.c_str(), data->str.size()));
+  default:
+    break;
+  }
+
+  if(memoize && data->frozen && data->hashValid && data->hashType == type) {
+    return data->hash;
+  }
+  if(type == Array) {
+    result = JSHash_combine(result, data->vector.size());
+    for(std::vector<JSValuePtr>::iterator it = data->vector.begin();
+        it != data->vector.end(); ++it) {
+      result = JSHash_combine(result, _Hash(*it, memoize));
+    }
+  } else {
+    size_t properties = 0;
+    for(std::map<std::string, JSValuePtr>::iterator it = data->map.begin();
+        it != data->map.end(); ++it) {
+      properties += JSHash_property(it->first, _Hash(it->second, memoize));
+    }
+    result = JSHash_combine(result, properties);
+  }
+  return result;
+}
+
+bool JSValueCpp::deepEquals(JSValueCpp& other) {
+  _Sync();
+  other._Sync();
+  if(type != other.type) return false;
+  if(data == other.data) return true;
+  switch(type) {
+  case Null:
+  case Undefined:
+    return true;
+  case Boolean:
+    return data->b == other.data->b;
+  case Number:
+    return JSDeepEquals_number(data->d, other.data->d);
+  case String:
+    return data->str == other.data->str;
+  default:
+    break;
+  }
+
+  // Note: only frozen nodes memoize their hashes, i.e., the hashes are up to date
+  if(data->frozen && other.data->frozen
+      && data->hashValid && other.data->hashValid
+      && data->hashType == type && other.data->hashType == type
+      && data->hash != other.data->hash) {
+    return false;
+  }
+  if(type == Array) {
+    if(data->vector.size() != other.data->vector.size()) return false;
+    for(size_t idx = 0; idx < data->vector.size(); ++idx) {
+      if(!_Equals(data->vector[idx], other.data->vector[idx])) return false;
+    }
+  } else {
+    // Note: both maps are ordered by key
+    if(data->map.size() != other.data->map.size()) return false;
+    std::map<std::string, JSValuePtr>::iterator it = data->map.begin();
+    std::map<std::string, JSValuePtr>::iterator otherIt = other.data->map.begin();
+    for(; it != data->map.end(); ++it, ++otherIt) {
+      if(it->first != otherIt->first) return false;
+      if(!_Equals(it->second, otherIt->second)) return false;
+    }
+  }
+  return true;
+}
+
+size_t JSValueCpp::_Hash(const JSValuePtr& child, bool memoize) {
+  return child ? _Impl(child)->hash(memoize) : JSHash_begin(Undefined);
+}
+
+bool JSValueCpp::_Equals(const JSValuePtr& a, const JSValuePtr& b) {
+  if(a && b) return _Impl(a)->deepEquals(*_Impl(b));
+  JSValueType typeA = a ? _Impl(a)->type : Undefined;
+  JSValueType typeB = b ? _Impl(b)->type : Undefined;
+  return typeA == Undefined && typeB == Undefined;
+}
+
 JSArrayPtr JSValueCpp::asArray() {
-  return JSArrayPtr(new JSArrayCpp(data));
+  _Sync();
+  JSArrayCpp* array = new JSArrayCpp(data);
+  JSArrayPtr result(array);
+  if(step) array->step.reset(new _Step(*step));
+  return result;
 }
 
 JSObjectPtr JSValueCpp::asObject() {
-  return JSObjectPtr(new JSObjectCpp(data));
+  _Sync();
+  JSObjectCpp* object = new JSObjectCpp(data);
+  JSObjectPtr result(object);
+  if(step) object->step.reset(new _Step(*step));
+  return result;
 }
 
 JSObjectPtr JSValueCpp::toObject(JSArrayPtr arr) {
-  return boost::dynamic_pointer_cast<JSObjectCpp>(arr);
+  return arr;
 }
 
 JSValuePtr JSValueCpp::toValue(JSArrayPtr arr) {
-  return boost::dynamic_pointer_cast<JSValueCpp>(arr);
+  return arr;
 }
 
 JSValuePtr JSValueCpp::toValue(JSObjectPtr obj) {
-  return boost::dynamic_pointer_cast<JSValueCpp>(obj);
+  return obj;
 }
 
 
-template<typename A>
-class JSVoidFunctionCpp: public JSVoidFunction<A> {
+template<typename... Args>
+class JSVoidFunctionCpp: public JSVoidFunctionImpl<void (*) (Args...), Args...> {
 public:
-  JSVoidFunctionCpp(void (*f) (A val)): f(f) {
+  JSVoidFunctionCpp(void (*f) (Args... args)): JSVoidFunctionImpl<void (*) (Args...), Args...>(f) {
   }
-
-  virtual void call(A val) {
-    f(val);
-  }
-
-private:
-  void (*f) (A val);
 };
 
-template<typename O, typename A>
-class JSVoidMemberFunctionCpp: public JSVoidFunction<A> {
+template<typename O, typename... Args>
+class JSVoidMemberFunctionCpp: public JSVoidFunction<Args...> {
 public:
-  JSVoidMemberFunctionCpp(O& obj, void (O::*f) (A val)): obj(obj), f(f) {
+  JSVoidMemberFunctionCpp(O& obj, void (O::*f) (Args... args)): f(f), obj(obj) {
   }
 
-  virtual void call(A val) {
-    ((obj).*(f)) (val);
+  virtual void call(Args... args) {
+    ((obj).*(f)) (args...);
   }
 
 private:
-  void (O::*f) (A val);
+  void (O::*f) (Args... args);
   O& obj;
 };
 
-template<typename A>
-typename JSVoidFunction<A>::Ptr CreateVoidFunction(void (*f) (A val) ) {
-  return typename JSVoidFunction<A>::Ptr(new JSVoidFunctionCpp<A>(f));
+template<typename... Args>
+typename JSVoidFunction<Args...>::Ptr CreateVoidFunction(void (*f) (Args... args) ) {
+  return typename JSVoidFunction<Args...>::Ptr(new JSVoidFunctionCpp<Args...>(f));
+}
+
+template<typename O, typename... Args>
+typename JSVoidFunction<Args...>::Ptr CreateMemberVoidFunction(O& obj, void (O::*f) (Args... args) ) {
+  return typename JSVoidFunction<Args...>::Ptr(new JSVoidMemberFunctionCpp<O, Args...>(obj, f));
+}
+
+// Wraps a lambda or functor, e.g., CreateVoidFunction<double, bool>(f).
+template<typename... Args, typename F>
+typename JSVoidFunction<Args...>::Ptr CreateVoidFunction(F f) {
+  return typename JSVoidFunction<Args...>::Ptr(new JSVoidFunctionImpl<F, Args...>(f));
 }
 
-template<typename O, typename A>
-typename JSVoidFunction<A>::Ptr CreateMemberVoidFunction(O& obj, void (O::*f) (A val) ) {
-  return typename JSVoidFunction<A>::Ptr(new JSVoidMemberFunctionCpp<O, A>(obj, f));
+template<typename R, typename... Args, typename F>
+typename JSFunction<R, Args...>::Ptr CreateFunction(F f) {
+  return typename JSFunction<R, Args...>::Ptr(new JSFunctionImpl<F, R, Args...>(f));
 }
 
+// Direct (non-virtual) access to this backend, see jsobjects_static.hpp.
+typedef JSStatic<JSContextCpp, JSValueCpp, JSObjectCpp, JSArrayCpp> JSStaticCpp;
 
 } // namespace jsobjects
 
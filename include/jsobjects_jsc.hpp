@@ -2,66 +2,78 @@
 #define JSOBJECTS_JSC_HPP
 
 #include "jsobjects.hpp"
+#include "jsobjects_static.hpp"
 
 #include <JavaScriptCore/JavaScript.h>
 #include <assert.h>
+#include <string.h>
+#include <exception>
+
+#include <boost/weak_ptr.hpp>
 
 namespace jsobjects {
 
 class JSObjectJSC;
 class JSArrayJSC;
+class JSContextJSC;
+class JSContextDataJSC;
+class JSScopeJSC;
+
+typedef boost::shared_ptr<JSContextDataJSC> JSContextDataJSCPtr;
+
+// Writes the UTF-8 representation of a JSString into 'result'.
+inline void JSStringJSC_toUTF8(JSStringRef jsstring, std::string& result) {
+  size_t length = JSStringGetLength(jsstring);
+  const JSChar* chars = JSStringGetCharactersPtr(jsstring);
+
+  // fast path: pure ASCII strings are copied directly
+  result.resize(length);
+  size_t idx = 0;
+  for(; idx < length && chars[idx] < 0x80; ++idx) {
+    result[idx] = static_cast<char>(chars[idx]);
+  }
+  if(idx == length) return;
+
+  size_t len = JSStringGetMaximumUTF8CStringSize(jsstring);
+  result.resize(len);
+  size_t written = JSStringGetUTF8CString(jsstring, &result[0], len);
+  // Note: 'written' includes the terminating 0
+  result.resize(written > 0 ? written - 1 : 0);
+}
 
 class JSValueJSC: virtual public JSValue {
 
 public:
 
-  JSValueJSC(JSContextRef context, JSValueRef val): context(context) {
-
-    if(val == 0) {
-      val = JSValueMakeNull(context);
-      type = Null;
-    } else if(JSValueIsUndefined(context, val)) {
-      type = Undefined;
-    } else if(JSValueIsNull(context, val)) {
-      type = Null;
-    } else if(JSValueIsBoolean(context, val)) {
-      type = Boolean;
-    } else if(JSValueIsNumber(context, val)) {
-      type = Number;
-    } else if(JSValueIsString(context, val)) {
-      type = String;
-    } else if(JSValueJSC::_IsArray(context, val)) {
-      type = Array;
-    } else if(JSValueIsObject(context, val)) {
-      type = Object;
-    } else {
-      // Note: there is no IsArray function in JSC
-      throw "Not yet supported";
-    }
+  JSValueJSC(JSContextRef context, JSValueRef val, const JSContextDataJSCPtr& owner = JSContextDataJSCPtr())
+    : context(context), owner(owner), typeKnown(false), scope(0), scopeSlot(0), borrowed(false) {
+    _SetValue(val);
+    _Retain();
+  }
 
-    // make the reference persistent
-    JSValueProtect(context, val);
-    value = val;
+  // Note: the value is neither protected nor registered with a scope;
+  //   'owner' lets the type check use the cached state of the context
+  JSValueJSC(JSContextRef context, JSValueRef val, JSBorrowed, const JSContextDataJSCPtr& owner = JSContextDataJSCPtr())
+    : context(context), owner(owner), typeKnown(false), scope(0), scopeSlot(0), borrowed(true) {
+    _SetValue(val);
   }
 
   virtual ~JSValueJSC() {
-    // release the persistent reference
-    JSValueUnprotect(context, value);
+    _Release();
   }
 
   inline virtual std::string asString() {
+    std::string result;
+    asString(result);
+    return result;
+  }
+
+  inline virtual void asString(std::string& result) {
     assert(JSValueIsString(context, value));
 
     JSStringRef jsstring = JSValueToStringCopy(context, value, /* JSValueRef *exception */ 0);
-    size_t len = JSStringGetMaximumUTF8CStringSize(jsstring);
-    char *cstr = new char[len];
-    JSStringGetUTF8CString(jsstring, cstr, len);
-    std::string result(cstr);
-
+    JSStringJSC_toUTF8(jsstring, result);
     JSStringRelease(jsstring);
-    delete[] cstr;
-
-    return result;
   }
 
   inline virtual double asDouble() {
@@ -80,7 +92,14 @@ public:
 
   inline virtual JSValuePtr toValue(JSObjectPtr obj);
 
-  inline virtual JSValueType getType() { return type; };
+  virtual void* getImpl() {
+    return this;
+  }
+
+  inline virtual JSValueType getType() {
+    if(!typeKnown) _Classify();
+    return type;
+  };
 
   inline virtual JSArrayPtr asArray();
 
@@ -89,63 +108,135 @@ public:
   JSContextRef context;
   JSValueRef value;
 
+  // the state of the context wrapper this value has been created by (might be empty)
+  // Note: shared, as values may outlive the wrapper
+  JSContextDataJSCPtr owner;
+
 protected:
 
   inline bool _IsArray(JSContextRef context, JSValueRef val);
-  inline JSObjectRef _GetArrayClassObj(JSContextRef context);
+  static inline JSObjectRef _GetArrayClassObj(JSContextRef context);
+  static inline bool _IsInstanceOf(JSContextRef context, JSValueRef val, JSObjectRef ctor);
+
+  inline void _Retain();
+  inline void _Release();
+
+  void _SetValue(JSValueRef val) {
+    if(val == 0) {
+      val = JSValueMakeNull(context);
+      type = Null;
+      typeKnown = true;
+    }
+
+    // Note: the type is determined on demand (see getType())
+    // as most values are just passed through
+    value = val;
+  }
+
+  inline void _Classify();
 
   JSValueType type;
+  bool typeKnown;
+
+private:
+
+  friend class JSScopeJSC;
+  friend class JSContextJSC;
+  friend class JSContextDataJSC;
+
+  // the scope that keeps this value alive instead of JSValueProtect
+  JSScopeJSC* scope;
+  size_t scopeSlot;
+
+  bool borrowed;
+};
+
+// Downcasts a value of this backend without RTTI.
+inline JSValueJSC* JSValueJSC_cast(JSValue* val) {
+  return static_cast<JSValueJSC*>(val->getImpl());
+}
+
+class JSPropertyKeyJSC: public JSPropertyKey {
+
+public:
+
+  JSPropertyKeyJSC(const std::string& key): key(JSStringCreateWithUTF8CString(key.c_str())) {}
+
+  virtual ~JSPropertyKeyJSC() {
+    JSStringRelease(key);
+  }
 
+  virtual std::string getName() {
+    std::string result;
+    JSStringJSC_toUTF8(key, result);
+    return result;
+  }
+
+  JSStringRef key;
 };
 
 class JSObjectJSC: public JSValueJSC, virtual public JSObject {
 
 public:
 
-  JSObjectJSC(JSContextRef context, JSObjectRef obj): JSValueJSC(context, obj), object(obj) {}
+  JSObjectJSC(JSContextRef context, JSObjectRef obj, const JSContextDataJSCPtr& owner = JSContextDataJSCPtr())
+    : JSValueJSC(context, obj, owner), object(obj) {}
 
-  JSObjectJSC(JSContextRef context, JSValueRef val): JSValueJSC(context, val) {
+  JSObjectJSC(JSContextRef context, JSValueRef val, const JSContextDataJSCPtr& owner = JSContextDataJSCPtr())
+    : JSValueJSC(context, val, owner) {
       assert(JSValueIsObject(context, val));
       object = JSValueToObject(context, val, 0);
   }
 
+  JSObjectJSC(JSContextRef context, JSValueRef val, JSBorrowed borrowed, const JSContextDataJSCPtr& owner = JSContextDataJSCPtr())
+    : JSValueJSC(context, val, borrowed, owner) {
+      assert(JSValueIsObject(context, val));
+      object = const_cast<JSObjectRef>(val);
+  }
+
   virtual ~JSObjectJSC() { }
 
-  virtual JSValuePtr get(const std::string& key) {
+  virtual JSValuePtr get(const JSStringView& key) {
     JSStringRef jskey = JSStringCreateWithUTF8CString(key.c_str());
     JSValueRef val = JSObjectGetProperty(context, object, jskey, /* JSValueRef *exception */ 0);
     JSStringRelease(jskey);
-    return JSValuePtr(new JSValueJSC(context, val));
+    return JSValuePtr(new JSValueJSC(context, val, owner));
   }
 
-  virtual void set(const std::string& key, JSValuePtr val) {
+  virtual void set(const JSStringView& key, JSValuePtr val) {
     JSStringRef jskey = JSStringCreateWithUTF8CString(key.c_str());
-    JSValueJSC* jscval = dynamic_cast<JSValueJSC*>(JSOBJECTS_PTR_GET(val));
+    JSValueJSC* jscval = JSValueJSC_cast(JSOBJECTS_PTR_GET(val));
     JSObjectSetProperty(context, object, jskey, jscval->value, kJSPropertyAttributeNone, /* JSValueRef *exception */ 0);
     JSStringRelease(jskey);
   }
 
-  virtual void set(const std::string& key, const std::string& val) {
+  virtual void set(const JSStringView& key, const std::string& val) {
     JSStringRef jskey = JSStringCreateWithUTF8CString(key.c_str());
     JSStringRef jsval = JSStringCreateWithUTF8CString(val.c_str());
     JSObjectSetProperty(context, object, jskey, JSValueMakeString(context, jsval), kJSPropertyAttributeNone, /* JSValueRef *exception */ 0);
+    JSStringRelease(jsval);
     JSStringRelease(jskey);
   }
 
-  virtual void set(const std::string& key, const char* val) {
+  virtual void set(const JSStringView& key, const char* val) {
     JSStringRef jskey = JSStringCreateWithUTF8CString(key.c_str());
     JSStringRef jsval = JSStringCreateWithUTF8CString(val);
     JSObjectSetProperty(context, object, jskey, JSValueMakeString(context, jsval), kJSPropertyAttributeNone, /* JSValueRef *exception */ 0);
+    JSStringRelease(jsval);
     JSStringRelease(jskey);
   }
 
-  virtual void set(const std::string& key, bool val) {
+  virtual void set(const JSStringView& key, std::string&& val) {
+    set(key, val.c_str());
+  }
+
+  virtual void set(const JSStringView& key, bool val) {
     JSStringRef jskey = JSStringCreateWithUTF8CString(key.c_str());
     JSObjectSetProperty(context, object, jskey, JSValueMakeBoolean(context, val), kJSPropertyAttributeNone, /* JSValueRef *exception */ 0);
     JSStringRelease(jskey);
   }
 
-  virtual void set(const std::string& key, double val) {
+  virtual void set(const JSStringView& key, double val) {
     JSStringRef jskey = JSStringCreateWithUTF8CString(key.c_str());
     JSObjectSetProperty(context, object, jskey, JSValueMakeNumber(context, val), kJSPropertyAttributeNone, /* JSValueRef *exception */ 0);
     JSStringRelease(jskey);
@@ -155,41 +246,165 @@ public:
     StrVector keys;
     JSPropertyNameArrayRef names_array = JSObjectCopyPropertyNames(context, object);
     size_t count = JSPropertyNameArrayGetCount(names_array);
-    keys.reserve(count);
+    keys.resize(count);
     for(size_t idx = 0; idx < count; ++idx) {
+      // Note: the names are plain strings, no need for a (protected) value wrapper
       JSStringRef str_ref = JSPropertyNameArrayGetNameAtIndex(names_array, idx);
-      JSValueJSC val(context, JSValueMakeString(context, str_ref));
-      keys[idx] = val.asString();
+      JSStringJSC_toUTF8(str_ref, keys[idx]);
     }
     JSPropertyNameArrayRelease(names_array);
     return keys;
   }
 
+  virtual void forEach(JSPropertyVisitor& visitor) {
+    JSPropertyNameArrayRef names_array = JSObjectCopyPropertyNames(context, object);
+    size_t count = JSPropertyNameArrayGetCount(names_array);
+    // Note: the key buffer is reused, and the name is used for the lookup as is
+    std::string key;
+    for(size_t idx = 0; idx < count; ++idx) {
+      JSStringRef str_ref = JSPropertyNameArrayGetNameAtIndex(names_array, idx);
+      JSValueRef val = JSObjectGetProperty(context, object, str_ref, /* JSValueRef *exception */ 0);
+      JSStringJSC_toUTF8(str_ref, key);
+      JSStackValue<JSValueJSC> value;
+      visitor.visit(key, *value.init(context, val, JSBorrowed(), owner));
+    }
+    JSPropertyNameArrayRelease(names_array);
+  }
+
+  virtual JSValuePtr get(const JSPropertyKeyPtr& key) {
+    JSValueRef val = JSObjectGetProperty(context, object, _key(key), /* JSValueRef *exception */ 0);
+    return JSValuePtr(new JSValueJSC(context, val, owner));
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, JSValuePtr val) {
+    JSValueJSC* jscval = JSValueJSC_cast(JSOBJECTS_PTR_GET(val));
+    JSObjectSetProperty(context, object, _key(key), jscval->value, kJSPropertyAttributeNone, /* JSValueRef *exception */ 0);
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, const std::string& val) {
+    set(key, val.c_str());
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, const char* val) {
+    JSStringRef jsval = JSStringCreateWithUTF8CString(val);
+    JSObjectSetProperty(context, object, _key(key), JSValueMakeString(context, jsval), kJSPropertyAttributeNone, /* JSValueRef *exception */ 0);
+    JSStringRelease(jsval);
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, bool val) {
+    JSObjectSetProperty(context, object, _key(key), JSValueMakeBoolean(context, val), kJSPropertyAttributeNone, /* JSValueRef *exception */ 0);
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, double val) {
+    JSObjectSetProperty(context, object, _key(key), JSValueMakeNumber(context, val), kJSPropertyAttributeNone, /* JSValueRef *exception */ 0);
+  }
+
+  virtual JSValuePtr call(const std::vector<JSValuePtr>& args) {
+    enum { ARGS = 8 };
+    JSValueRef fixed[ARGS];
+    std::vector<JSValueRef> dynamic;
+    JSValueRef* argv = fixed;
+    if(args.size() > ARGS) {
+      dynamic.resize(args.size());
+      argv = &dynamic[0];
+    }
+    for(size_t idx = 0; idx < args.size(); ++idx) {
+      argv[idx] = JSValueJSC_cast(JSOBJECTS_PTR_GET(args[idx]))->value;
+    }
+    JSValueRef result = JSObjectCallAsFunction(context, object, 0, args.size(), argv, /* JSValueRef *exception */ 0);
+    return JSValuePtr(new JSValueJSC(context, result, owner));
+  }
+
+  // Note: arguments and results are passed as raw references which stay
+  //   on the stack during the call, i.e., nothing is wrapped or protected
+  virtual void callEach(JSArrayPtr args, JSArrayPtr results) {
+    JSObjectRef argsObj = const_cast<JSObjectRef>(JSValueJSC_cast(JSOBJECTS_PTR_GET(args))->value);
+    JSObjectRef resultsObj = const_cast<JSObjectRef>(JSValueJSC_cast(JSOBJECTS_PTR_GET(results))->value);
+    unsigned int length = args->length();
+    JSValueRef argv[2];
+    for(unsigned int idx = 0; idx < length; ++idx) {
+      argv[0] = JSObjectGetPropertyAtIndex(context, argsObj, idx, /* JSValueRef *exception */ 0);
+      argv[1] = JSValueMakeNumber(context, idx);
+      _SetResult(resultsObj, idx, JSObjectCallAsFunction(context, object, 0, 2, argv, /* JSValueRef *exception */ 0));
+    }
+  }
+
+  virtual void callEach(const std::vector<JSValuePtr>& args, JSArrayPtr results) {
+    JSObjectRef resultsObj = const_cast<JSObjectRef>(JSValueJSC_cast(JSOBJECTS_PTR_GET(results))->value);
+    JSValueRef argv[2];
+    for(size_t idx = 0; idx < args.size(); ++idx) {
+      argv[0] = JSValueJSC_cast(JSOBJECTS_PTR_GET(args[idx]))->value;
+      argv[1] = JSValueMakeNumber(context, idx);
+      _SetResult(resultsObj, idx, JSObjectCallAsFunction(context, object, 0, 2, argv, /* JSValueRef *exception */ 0));
+    }
+  }
+
+#ifdef JSOBJECTS_JSC_HAVE_TYPED_ARRAYS
+  // Returns the backing store if this object is an ArrayBuffer, 0 otherwise.
+  // Note: as all JSC typed array pointers this pointer is temporary, i.e.,
+  //   it must not be kept across JavaScriptCore API calls.
+  void* getArrayBufferData(size_t* byteLength = 0) {
+    if(JSValueGetTypedArrayType(context, object, 0) != kJSTypedArrayTypeArrayBuffer) {
+      return 0;
+    }
+    if(byteLength != 0) {
+      *byteLength = JSObjectGetArrayBufferByteLength(context, object, 0);
+    }
+    return JSObjectGetArrayBufferBytesPtr(context, object, 0);
+  }
+#endif
+
   JSObjectRef object;
+
+protected:
+
+  static JSStringRef _key(const JSPropertyKeyPtr& key) {
+    return static_cast<JSPropertyKeyJSC*>(JSOBJECTS_PTR_GET(key))->key;
+  }
+
+  // Note: a call that threw yields 0, which is stored as undefined
+  void _SetResult(JSObjectRef results, unsigned int index, JSValueRef result) {
+    if(result == 0) result = JSValueMakeUndefined(context);
+    JSObjectSetPropertyAtIndex(context, results, index, result, /* JSValueRef *exception */ 0);
+  }
 };
 
 class JSArrayJSC: public JSObjectJSC, virtual public JSArray {
 
 public:
 
-  JSArrayJSC(JSContextRef context, JSObjectRef arr): JSObjectJSC(context, arr) { }
+  JSArrayJSC(JSContextRef context, JSObjectRef arr, const JSContextDataJSCPtr& owner = JSContextDataJSCPtr())
+    : JSObjectJSC(context, arr, owner) {
+    type = Array;
+    typeKnown = true;
+  }
+
+  JSArrayJSC(JSContextRef context, JSValueRef arr, JSBorrowed borrowed, const JSContextDataJSCPtr& owner = JSContextDataJSCPtr())
+    : JSObjectJSC(context, arr, borrowed, owner) {
+    type = Array;
+    typeKnown = true;
+  }
 
   virtual JSValuePtr getAt(unsigned int index) {
-    return JSValuePtr(new JSValueJSC(context, JSObjectGetPropertyAtIndex(context, object, index, /* JSValueRef *exception */ 0)));
+    return JSValuePtr(new JSValueJSC(context, JSObjectGetPropertyAtIndex(context, object, index, /* JSValueRef *exception */ 0), owner));
   }
 
   virtual void setAt(unsigned int index, JSValuePtr val) {
-    JSObjectSetPropertyAtIndex(context, object, index, dynamic_cast<JSValueJSC*>(JSOBJECTS_PTR_GET(val))->value, /* JSValueRef *exception */ 0);
+    JSObjectSetPropertyAtIndex(context, object, index, JSValueJSC_cast(JSOBJECTS_PTR_GET(val))->value, /* JSValueRef *exception */ 0);
   };
 
   virtual void setAt(unsigned int index, const std::string& val) {
-    JSStringRef jsval = JSStringCreateWithUTF8CString(val.c_str());
-    JSObjectSetPropertyAtIndex(context, object, index, JSValueMakeString(context, jsval), /* JSValueRef *exception */ 0);
+    setAt(index, val.c_str());
   }
 
   virtual void setAt(unsigned int index, const char* val) {
     JSStringRef jsval = JSStringCreateWithUTF8CString(val);
     JSObjectSetPropertyAtIndex(context, object, index, JSValueMakeString(context, jsval), /* JSValueRef *exception */ 0);
+    JSStringRelease(jsval);
+  }
+
+  virtual void setAt(unsigned int index, std::string&& val) {
+    setAt(index, val.c_str());
   }
 
   virtual void setAt(unsigned int index, bool val) {
@@ -201,35 +416,113 @@ public:
   }
 
   inline virtual unsigned int length();
+
+  inline virtual void readDoubles(unsigned int begin, unsigned int count, double* result);
+
+  inline virtual void writeDoubles(unsigned int begin, unsigned int count, const double* values);
+
+#ifdef JSOBJECTS_JSC_HAVE_TYPED_ARRAYS
+  // Returns the backing store if this array is a Float64Array, 0 otherwise.
+  // Note: as all JSC typed array pointers this pointer is temporary, i.e.,
+  //   it must not be kept across JavaScriptCore API calls.
+  inline double* getFloat64Data(size_t* length = 0);
+#endif
+};
+
+/**
+ * The state of a JSContextJSC, shared with the values and native functions
+ * created through it.
+ *
+ * Values refer to this state instead of the wrapper, as they may outlive it,
+ * e.g., when a binding or a JSContextPoolJSC replaces the wrapper.
+ */
+class JSContextDataJSC {
+
+public:
+
+  JSContextDataJSC(JSContextRef context): context(context), scope(0), arrayClass(0) {
+    // Note: the global context is retained, as the state belongs to it
+    //   (e.g., the Array constructor)
+    globalContext = JSGlobalContextRetain(JSContextGetGlobalContext(context));
+  }
+
+  ~JSContextDataJSC() {
+    if(arrayClass != 0) {
+      JSValueUnprotect(globalContext, arrayClass);
+    }
+    JSGlobalContextRelease(globalContext);
+  }
+
+  inline bool isArray(JSValueRef val);
+
+  JSContextRef context;
+  JSGlobalContextRef globalContext;
+
+  // the innermost open JSScopeJSC, or 0
+  JSScopeJSC* scope;
+
+  // the Array constructor of this context, fetched on first use
+  JSObjectRef arrayClass;
+
+private:
+
+  JSContextDataJSC(const JSContextDataJSC&);
+  JSContextDataJSC& operator=(const JSContextDataJSC&);
 };
 
 class JSContextJSC : public JSContext {
 
 public:
 
-  JSContextJSC(JSContextRef context) : context(context) {
+  JSContextJSC(JSContextRef context) : context(context), data(new JSContextDataJSC(context)) {}
+
+  // Wraps the state of another wrapper, e.g., during a call of a native function.
+  JSContextJSC(JSContextRef context, const JSContextDataJSCPtr& data) : context(context), data(data) {}
+
+  virtual ~JSContextJSC() {}
+
+  bool isArray(JSValueRef val) {
+    return data->isArray(val);
+  }
+
+  JSGlobalContextRef getGlobalContext() {
+    return data->globalContext;
+  }
+
+  // the innermost open JSScopeJSC, or 0
+  JSScopeJSC* getScope() {
+    return data->scope;
+  }
+
+  const JSContextDataJSCPtr& getData() {
+    return data;
   }
 
   virtual JSValuePtr newString(const std::string& val) {
-    JSStringRef jsval = JSStringCreateWithUTF8CString(val.c_str());
-    return JSValuePtr(new JSValueJSC(context, JSValueMakeString(context, jsval)));
+    return newString(val.c_str());
   }
 
   virtual JSValuePtr newString(const char* val) {
     JSStringRef jsval = JSStringCreateWithUTF8CString(val);
-    return JSValuePtr(new JSValueJSC(context, JSValueMakeString(context, jsval)));
+    JSValuePtr result(new JSValueJSC(context, JSValueMakeString(context, jsval), data));
+    JSStringRelease(jsval);
+    return result;
   };
 
+  virtual JSValuePtr newString(std::string&& val) {
+    return newString(val.c_str());
+  }
+
   virtual JSValuePtr newBoolean(bool val) {
-    return JSValuePtr(new JSValueJSC(context, JSValueMakeBoolean(context, val)));
+    return JSValuePtr(new JSValueJSC(context, JSValueMakeBoolean(context, val), data));
   };
 
   virtual JSValuePtr newNumber(double val) {
-    return JSValuePtr(new JSValueJSC(context, JSValueMakeNumber(context, val)));
+    return JSValuePtr(new JSValueJSC(context, JSValueMakeNumber(context, val), data));
   }
 
   virtual JSObjectPtr newObject() {
-    JSObjectJSC* obj = new JSObjectJSC(context, JSObjectMake(context, 0, 0));
+    JSObjectJSC* obj = new JSObjectJSC(context, JSObjectMake(context, 0, 0), data);
     return JSObjectPtr(obj);
   }
 
@@ -239,49 +532,280 @@ public:
       arguments[idx] = JSValueMakeUndefined(context);
     }
     JSObjectRef obj = JSObjectMakeArray(context, length, arguments, 0);
-    JSArrayPtr result(new JSArrayJSC(context, obj));
+    JSArrayPtr result(new JSArrayJSC(context, obj, data));
     delete[] arguments;
     return result;
   }
 
   virtual JSValuePtr null() {
-    return JSValuePtr(new JSValueJSC(context, JSValueMakeNull(context)));
+    return JSValuePtr(new JSValueJSC(context, JSValueMakeNull(context), data));
   };
 
   virtual JSValuePtr undefined() {
     JSValueRef undefined = JSValueMakeUndefined(context);
-    return JSValuePtr(new JSValueJSC(context, undefined));
+    return JSValuePtr(new JSValueJSC(context, undefined, data));
   };
 
+  virtual JSPropertyKeyPtr newPropertyKey(const std::string& key) {
+    return JSPropertyKeyPtr(new JSPropertyKeyJSC(key));
+  }
+
+  // Note: the function refers to the state of this wrapper (see getData()) weakly,
+  //   i.e., it keeps neither the state nor the context alive, and it may be
+  //   called after the wrapper has been destroyed
+  inline virtual JSObjectPtr newFunction(JSNativeCallbackPtr callback);
+
+#ifdef JSOBJECTS_JSC_HAVE_TYPED_ARRAYS
+  // Creates a Float64Array with the given length, initialized with zeros.
+  JSArrayPtr newFloat64Array(unsigned int length) {
+    JSObjectRef arr = JSObjectMakeTypedArray(context, kJSTypedArrayTypeFloat64Array, length, 0);
+    return JSArrayPtr(new JSArrayJSC(context, arr, data));
+  }
+
+  // Creates a Float64Array that uses 'bytes' as backing store without copying.
+  // 'deallocator' is called when the array has been garbage collected.
+  JSArrayPtr newFloat64Array(double* bytes, unsigned int length,
+      JSTypedArrayBytesDeallocator deallocator, void* deallocatorContext) {
+    JSObjectRef arr = JSObjectMakeTypedArrayWithBytesNoCopy(context, kJSTypedArrayTypeFloat64Array,
+      bytes, length * sizeof(double), deallocator, deallocatorContext, 0);
+    return JSArrayPtr(new JSArrayJSC(context, arr, data));
+  }
+
+  // Creates an ArrayBuffer that uses 'bytes' as backing store without copying.
+  // 'deallocator' is called when the buffer has been garbage collected.
+  JSObjectPtr newArrayBuffer(void* bytes, size_t byteLength,
+      JSTypedArrayBytesDeallocator deallocator, void* deallocatorContext) {
+    JSObjectRef buf = JSObjectMakeArrayBufferWithBytesNoCopy(context, bytes, byteLength,
+      deallocator, deallocatorContext, 0);
+    return JSObjectPtr(new JSObjectJSC(context, buf, data));
+  }
+#endif
+
   virtual std::string toJson(JSValuePtr val) {
-    JSValueJSC* _val = dynamic_cast<JSValueJSC*>(JSOBJECTS_PTR_GET(val));
+    JSValueJSC* _val = JSValueJSC_cast(JSOBJECTS_PTR_GET(val));
     JSStringRef json_str = JSValueCreateJSONString(context, _val->value, 0, 0);
-    JSValueJSC strval(context, JSValueMakeString(context, json_str));
-    if(strval.isString())
-      return strval.asString();
+    if(json_str == 0)
+      return "serialisation error";
 
-    return "serialisation error";
+    std::string result;
+    JSStringJSC_toUTF8(json_str, result);
+    JSStringRelease(json_str);
+    return result;
   };
 
   virtual JSValuePtr fromJson(const std::string& str) {
     JSStringRef jsstr = JSStringCreateWithUTF8CString(str.c_str());
     JSValueRef val = JSValueMakeFromJSONString(context, jsstr);
+    JSStringRelease(jsstr);
 
     // TODO: throw exception
     if (val == 0) return undefined();
 
-    JSValuePtr result(new JSValueJSC(context, val));
-    JSStringRelease(jsstr);
-    return result;
+    return JSValuePtr(new JSValueJSC(context, val, data));
   };
 
 
 private:
 
+  friend class JSScopeJSC;
+
   JSContextRef context;
 
+  JSContextDataJSCPtr data;
+
+  // Note: use the shared state (see getData()) to refer to this context
+  JSContextJSC(const JSContextJSC&);
+  JSContextJSC& operator=(const JSContextJSC&);
+};
+
+/**
+ * Keeps values created in a native call frame alive without protecting them.
+ *
+ * While a scope is open, values created through its JSContextJSC (and values
+ * derived from those, e.g. via get() or getAt()) are not registered with
+ * JSValueProtect. Instead their references are stored in a slot buffer
+ * inside the scope object. As the scope must be a local variable, this
+ * buffer is part of the native stack which JSC scans conservatively during
+ * garbage collection.
+ *
+ * Values that are still referenced when the scope is closed escape
+ * and are protected at that point. The slots of released values are
+ * reused; only when more values are alive at the same time than there
+ * are slots, new values are protected right away.
+ *
+ * Usage:
+ *
+ *     JSScopeJSC scope(context);
+ *     JSArrayPtr arr = context.fromJson(str)->asArray();
+ *     for(unsigned int idx = 0; idx < arr->length(); ++idx) { ... }
+ */
+class JSScopeJSC {
+
+public:
+
+  JSScopeJSC(JSContextJSC& context): context(context), previous(context.data->scope), used(0), freed(0) {
+    context.data->scope = this;
+  }
+
+  ~JSScopeJSC() {
+    for(size_t idx = 0; idx < used; ++idx) {
+      JSValueJSC* val = values[idx];
+      if(val != 0) {
+        JSValueProtect(val->context, val->value);
+        val->scope = 0;
+      }
+    }
+    context.data->scope = previous;
+  }
+
+private:
+
+  friend class JSValueJSC;
+
+  enum { SLOTS = 128 };
+
+  inline bool enter(JSValueJSC* val) {
+    size_t slot;
+    if(freed > 0) {
+      slot = freeSlots[--freed];
+    } else if(used < SLOTS) {
+      slot = used++;
+    } else {
+      return false;
+    }
+    slots[slot] = val->value;
+    values[slot] = val;
+    val->scope = this;
+    val->scopeSlot = slot;
+    return true;
+  }
+
+  inline void leave(JSValueJSC* val) {
+    slots[val->scopeSlot] = 0;
+    values[val->scopeSlot] = 0;
+    freeSlots[freed++] = val->scopeSlot;
+  }
+
+  JSContextJSC& context;
+  JSScopeJSC* previous;
+
+  // Note: 'slots' is what the garbage collector finds on the stack
+  JSValueRef slots[SLOTS];
+  JSValueJSC* values[SLOTS];
+  size_t used;
+
+  // the released slots below 'used', reused first
+  size_t freeSlots[SLOTS];
+  size_t freed;
+
+  // scopes must live on the stack
+  JSScopeJSC(const JSScopeJSC&);
+  JSScopeJSC& operator=(const JSScopeJSC&);
+  void* operator new(size_t);
+};
+
+void JSValueJSC::_Retain() {
+  assert(!borrowed);
+  JSScopeJSC* current = owner ? owner->scope : 0;
+  if(current == 0 || !current->enter(this)) {
+    // make the reference persistent
+    JSValueProtect(context, value);
+  }
+}
+
+// The private data of function objects created by JSContextJSC::newFunction().
+struct JSFunctionDataJSC {
+  JSNativeCallbackPtr callback;
+  // Note: weak, as the state retains the global context, which in turn keeps
+  //   the functions installed on it
+  boost::weak_ptr<JSContextDataJSC> owner;
 };
 
+inline JSValueRef JSFunctionJSC_throw(JSContextRef context, const char* message, JSValueRef* exception) {
+  JSStringRef jsmessage = JSStringCreateWithUTF8CString(message);
+  JSValueRef arg = JSValueMakeString(context, jsmessage);
+  JSStringRelease(jsmessage);
+  *exception = JSObjectMakeError(context, 1, &arg, 0);
+  return JSValueMakeUndefined(context);
+}
+
+inline JSValueRef JSFunctionJSC_callAsFunction(JSContextRef context, JSObjectRef function,
+    JSObjectRef thisObject, size_t argc, const JSValueRef argv[], JSValueRef* exception) {
+  JSFunctionDataJSC* data = static_cast<JSFunctionDataJSC*>(JSObjectGetPrivate(function));
+
+  // Note: C++ exceptions must not unwind through JavaScriptCore
+  try {
+    // the state of the creating wrapper, or a new one if no wrapper or value keeps it anymore
+    JSContextDataJSCPtr state = data->owner.lock();
+    if(!state) {
+      state.reset(new JSContextDataJSC(context));
+      data->owner = state;
+    }
+    JSContextJSC owner(context, state);
+
+    // Note: arguments and result live only during the call,
+    //   i.e., they are kept alive by the call frame
+    JSScopeJSC scope(owner);
+
+    enum { ARGS = 8 };
+    JSValuePtr fixed[ARGS];
+    std::vector<JSValuePtr> dynamic;
+    JSValuePtr* args = fixed;
+    if(argc > ARGS) {
+      dynamic.resize(argc);
+      args = &dynamic[0];
+    }
+    for(size_t idx = 0; idx < argc; ++idx) {
+      args[idx].reset(new JSValueJSC(context, argv[idx], state));
+    }
+
+    JSValuePtr result = data->callback->invoke(owner, argc, args);
+    // a callback without a result returns undefined
+    if(!result) return JSValueMakeUndefined(context);
+    return JSValueJSC_cast(JSOBJECTS_PTR_GET(result))->value;
+  } catch(std::exception& e) {
+    return JSFunctionJSC_throw(context, e.what(), exception);
+  } catch(const char* message) {
+    return JSFunctionJSC_throw(context, message, exception);
+  } catch(...) {
+    return JSFunctionJSC_throw(context, "Unknown native exception", exception);
+  }
+}
+
+inline void JSFunctionJSC_finalize(JSObjectRef function) {
+  delete static_cast<JSFunctionDataJSC*>(JSObjectGetPrivate(function));
+}
+
+inline JSClassRef JSFunctionJSC_createClass() {
+  JSClassDefinition definition = kJSClassDefinitionEmpty;
+  definition.className = "NativeFunction";
+  definition.callAsFunction = JSFunctionJSC_callAsFunction;
+  definition.finalize = JSFunctionJSC_finalize;
+  return JSClassCreate(&definition);
+}
+
+// Note: JSObjectMakeFunctionWithCallback can not carry the callback,
+//   therefore a class with a call handler and private data is used
+JSObjectPtr JSContextJSC::newFunction(JSNativeCallbackPtr callback) {
+  static JSClassRef functionClass = JSFunctionJSC_createClass();
+
+  JSFunctionDataJSC* data = new JSFunctionDataJSC();
+  data->callback = callback;
+  data->owner = this->data;
+  JSObjectRef function = JSObjectMake(context, functionClass, data);
+  return JSObjectPtr(new JSObjectJSC(context, function, this->data));
+}
+
+void JSValueJSC::_Release() {
+  if(borrowed) return;
+  if(scope != 0) {
+    scope->leave(this);
+  } else {
+    // release the persistent reference
+    JSValueUnprotect(context, value);
+  }
+}
+
 
 JSObjectRef JSValueJSC::_GetArrayClassObj(JSContextRef context)
 {
@@ -302,23 +826,76 @@ JSObjectRef JSValueJSC::_GetArrayClassObj(JSContextRef context)
         }
       }
     }
-    assert(false);
     return NULL;
 }
 
-bool JSValueJSC::_IsArray(JSContextRef context, JSValueRef value)
+bool JSValueJSC::_IsInstanceOf(JSContextRef context, JSValueRef value, JSObjectRef ctor)
 {
-  static JSObjectRef array_class_obj = _GetArrayClassObj(context);
-
-  if(array_class_obj == 0 || context == 0 || value == 0) {
+  if(ctor == 0 || context == 0 || value == 0) {
     /* oh oh ... that is bad */
     return false;
   }
 
   JSValueRef exception = 0;
-  bool is_array =  JSValueIsInstanceOfConstructor(
-        context, value, array_class_obj, &exception);
-  return (exception == 0 && is_array);
+  bool is_instance =  JSValueIsInstanceOfConstructor(
+        context, value, ctor, &exception);
+  return (exception == 0 && is_instance);
+}
+
+void JSValueJSC::_Classify() {
+  // Note: JSValueGetType answers with one call what would need
+  //   a chain of JSValueIs* calls otherwise
+  switch(JSValueGetType(context, value)) {
+    case kJSTypeUndefined:
+      type = Undefined;
+      break;
+    case kJSTypeNull:
+      type = Null;
+      break;
+    case kJSTypeBoolean:
+      type = Boolean;
+      break;
+    case kJSTypeNumber:
+      type = Number;
+      break;
+    case kJSTypeString:
+      type = String;
+      break;
+    case kJSTypeObject:
+      type = _IsArray(context, value) ? Array : Object;
+      break;
+    default:
+      throw "Not yet supported";
+  }
+  typeKnown = true;
+}
+
+bool JSValueJSC::_IsArray(JSContextRef context, JSValueRef value)
+{
+  if(owner) {
+    return owner->isArray(value);
+  }
+
+#ifdef JSOBJECTS_JSC_HAVE_JSVALUEISARRAY
+  return JSValueIsArray(context, value);
+#else
+  // Note: without a JSContextJSC there is no place to cache the constructor
+  return _IsInstanceOf(context, value, _GetArrayClassObj(context));
+#endif
+}
+
+bool JSContextDataJSC::isArray(JSValueRef val)
+{
+#ifdef JSOBJECTS_JSC_HAVE_JSVALUEISARRAY
+  return JSValueIsArray(context, val);
+#else
+  if(arrayClass == 0) {
+    arrayClass = JSValueJSC::_GetArrayClassObj(context);
+    if(arrayClass == 0) return false;
+    JSValueProtect(globalContext, arrayClass);
+  }
+  return JSValueJSC::_IsInstanceOf(context, val, arrayClass);
+#endif
 }
 
 unsigned int JSArrayJSC::length() {
@@ -329,37 +906,211 @@ unsigned int JSArrayJSC::length() {
   JSValueRef _length =
       JSObjectGetProperty(context, object, LENGTH, &exception);
 
-  JSValueJSC js_length(context, _length);
-  if (exception == 0 && js_length.isNumber()) {
-    double length = js_length.asDouble();
+  // Note: the length is a temporary, i.e., no value wrapper needed
+  if (exception == 0 && JSValueIsNumber(context, _length)) {
+    double length = JSValueToNumber(context, _length, 0);
     return length >= 0 ? static_cast<unsigned int>(length) : 0;
   }
 
   return 0;
 }
 
+void JSArrayJSC::readDoubles(unsigned int begin, unsigned int count, double* result) {
+#ifdef JSOBJECTS_JSC_HAVE_TYPED_ARRAYS
+  size_t len;
+  double* data = getFloat64Data(&len);
+  if(data != 0) {
+    assert(begin + count <= len);
+    memcpy(result, data + begin, count * sizeof(double));
+    return;
+  }
+#endif
+
+  // Note: no value wrappers for the elements
+  for(unsigned int idx = 0; idx < count; ++idx) {
+    JSValueRef val = JSObjectGetPropertyAtIndex(context, object, begin + idx, /* JSValueRef *exception */ 0);
+    result[idx] = JSValueToNumber(context, val, /* JSValueRef *exception */ 0);
+  }
+}
+
+void JSArrayJSC::writeDoubles(unsigned int begin, unsigned int count, const double* values) {
+#ifdef JSOBJECTS_JSC_HAVE_TYPED_ARRAYS
+  size_t len;
+  double* data = getFloat64Data(&len);
+  if(data != 0) {
+    assert(begin + count <= len);
+    memcpy(data + begin, values, count * sizeof(double));
+    return;
+  }
+#endif
+
+  for(unsigned int idx = 0; idx < count; ++idx) {
+    JSObjectSetPropertyAtIndex(context, object, begin + idx, JSValueMakeNumber(context, values[idx]), /* JSValueRef *exception */ 0);
+  }
+}
+
+#ifdef JSOBJECTS_JSC_HAVE_TYPED_ARRAYS
+double* JSArrayJSC::getFloat64Data(size_t* length) {
+  if(JSValueGetTypedArrayType(context, object, 0) != kJSTypedArrayTypeFloat64Array) {
+    return 0;
+  }
+  if(length != 0) {
+    *length = JSObjectGetTypedArrayLength(context, object, 0);
+  }
+  // Note: the bytes pointer refers to the start of the underlying buffer
+  char* bytes = static_cast<char*>(JSObjectGetTypedArrayBytesPtr(context, object, 0));
+  return reinterpret_cast<double*>(bytes + JSObjectGetTypedArrayByteOffset(context, object, 0));
+}
+#endif
+
 JSArrayPtr JSValueJSC::asArray() {
   assert(isArray());
-  return JSArrayPtr(new JSArrayJSC(context, const_cast<JSObjectRef>(value)));
+  return JSArrayPtr(new JSArrayJSC(context, const_cast<JSObjectRef>(value), owner));
 }
 
 JSObjectPtr JSValueJSC::asObject() {
   assert(isObject());
-  return JSObjectPtr(new JSObjectJSC(context, const_cast<JSObjectRef>(value)));
+  return JSObjectPtr(new JSObjectJSC(context, const_cast<JSObjectRef>(value), owner));
 }
 
 JSObjectPtr JSValueJSC::toObject(JSArrayPtr arr) {
-  return boost::dynamic_pointer_cast<JSObjectJSC>(arr);
+  return arr;
 }
 
 JSValuePtr JSValueJSC::toValue(JSArrayPtr arr) {
-  return boost::dynamic_pointer_cast<JSValueJSC>(arr);
+  return arr;
 }
 
 JSValuePtr JSValueJSC::toValue(JSObjectPtr obj) {
-  return boost::dynamic_pointer_cast<JSValueJSC>(obj);
+  return obj;
+}
+
+// Conversion of std::vector to and from engine values, e.g., for bindings.
+// Numeric vectors become typed arrays (if available) which are filled with
+// a single copy; other vectors become plain arrays created in one call.
+
+template <typename T>
+struct JSVectorTraitsJSC;
+
+template <>
+struct JSVectorTraitsJSC<double> {
+  static JSValueRef toJS(JSContextRef context, double val) {
+    return JSValueMakeNumber(context, val);
+  }
+  static double fromJS(JSContextRef context, JSValueRef val) {
+    return JSValueToNumber(context, val, /* JSValueRef *exception */ 0);
+  }
+};
+
+template <>
+struct JSVectorTraitsJSC<int> {
+  static JSValueRef toJS(JSContextRef context, int val) {
+    return JSValueMakeNumber(context, val);
+  }
+  static int fromJS(JSContextRef context, JSValueRef val) {
+    return static_cast<int>(JSValueToNumber(context, val, /* JSValueRef *exception */ 0));
+  }
+};
+
+template <>
+struct JSVectorTraitsJSC<std::string> {
+  static JSValueRef toJS(JSContextRef context, const std::string& val) {
+    JSStringRef jsstring = JSStringCreateWithUTF8CString(val.c_str());
+    JSValueRef result = JSValueMakeString(context, jsstring);
+    JSStringRelease(jsstring);
+    return result;
+  }
+  static std::string fromJS(JSContextRef context, JSValueRef val) {
+    std::string result;
+    JSStringRef jsstring = JSValueToStringCopy(context, val, /* JSValueRef *exception */ 0);
+    JSStringJSC_toUTF8(jsstring, result);
+    JSStringRelease(jsstring);
+    return result;
+  }
+};
+
+// Fallbacks for element types without a typed array.
+template <typename T>
+inline bool JSVectorJSC_toTypedArray(JSContextRef, const std::vector<T>&, JSValueRef&) {
+  return false;
+}
+
+template <typename T>
+inline bool JSVectorJSC_fromTypedArray(JSContextRef, JSValueRef, std::vector<T>&) {
+  return false;
+}
+
+#ifdef JSOBJECTS_JSC_HAVE_TYPED_ARRAYS
+template <typename T>
+inline JSValueRef JSVectorJSC_makeTypedArray(JSContextRef context, JSTypedArrayType type, const std::vector<T>& vec) {
+  JSObjectRef arr = JSObjectMakeTypedArray(context, type, vec.size(), /* JSValueRef *exception */ 0);
+  if(!vec.empty()) {
+    memcpy(JSObjectGetTypedArrayBytesPtr(context, arr, 0), &vec[0], vec.size() * sizeof(T));
+  }
+  return arr;
+}
+
+template <typename T>
+inline bool JSVectorJSC_copyTypedArray(JSContextRef context, JSTypedArrayType type, JSValueRef val, std::vector<T>& result) {
+  if(JSValueGetTypedArrayType(context, val, 0) != type) return false;
+  JSObjectRef arr = const_cast<JSObjectRef>(val);
+  result.resize(JSObjectGetTypedArrayLength(context, arr, 0));
+  if(!result.empty()) {
+    char* bytes = static_cast<char*>(JSObjectGetTypedArrayBytesPtr(context, arr, 0));
+    memcpy(&result[0], bytes + JSObjectGetTypedArrayByteOffset(context, arr, 0), result.size() * sizeof(T));
+  }
+  return true;
+}
+
+inline bool JSVectorJSC_toTypedArray(JSContextRef context, const std::vector<double>& vec, JSValueRef& result) {
+  result = JSVectorJSC_makeTypedArray(context, kJSTypedArrayTypeFloat64Array, vec);
+  return true;
+}
+
+inline bool JSVectorJSC_toTypedArray(JSContextRef context, const std::vector<int>& vec, JSValueRef& result) {
+  result = JSVectorJSC_makeTypedArray(context, kJSTypedArrayTypeInt32Array, vec);
+  return true;
+}
+
+inline bool JSVectorJSC_fromTypedArray(JSContextRef context, JSValueRef val, std::vector<double>& result) {
+  return JSVectorJSC_copyTypedArray(context, kJSTypedArrayTypeFloat64Array, val, result);
+}
+
+inline bool JSVectorJSC_fromTypedArray(JSContextRef context, JSValueRef val, std::vector<int>& result) {
+  return JSVectorJSC_copyTypedArray(context, kJSTypedArrayTypeInt32Array, val, result);
+}
+#endif
+
+template <typename T>
+JSValueRef JSVectorJSC_toJS(JSContextRef context, const std::vector<T>& vec) {
+  JSValueRef result;
+  if(JSVectorJSC_toTypedArray(context, vec, result)) return result;
+
+  // Note: the element references are kept on the stack (in 'elements')
+  //   until the array has been created
+  std::vector<JSValueRef> elements(vec.size());
+  for(size_t idx = 0; idx < vec.size(); ++idx) {
+    elements[idx] = JSVectorTraitsJSC<T>::toJS(context, vec[idx]);
+  }
+  return JSObjectMakeArray(context, elements.size(), elements.empty() ? 0 : &elements[0], /* JSValueRef *exception */ 0);
+}
+
+template <typename T>
+void JSVectorJSC_fromJS(JSContextRef context, JSValueRef val, std::vector<T>& result) {
+  if(JSVectorJSC_fromTypedArray(context, val, result)) return;
+
+  JSObjectRef arr = JSValueToObject(context, val, /* JSValueRef *exception */ 0);
+  static JSStringRef LENGTH = JSStringCreateWithUTF8CString("length");
+  JSValueRef length = JSObjectGetProperty(context, arr, LENGTH, /* JSValueRef *exception */ 0);
+  result.resize(static_cast<size_t>(JSValueToNumber(context, length, /* JSValueRef *exception */ 0)));
+  for(size_t idx = 0; idx < result.size(); ++idx) {
+    JSValueRef element = JSObjectGetPropertyAtIndex(context, arr, idx, /* JSValueRef *exception */ 0);
+    result[idx] = JSVectorTraitsJSC<T>::fromJS(context, element);
+  }
 }
 
+// Direct (non-virtual) access to this backend, see jsobjects_static.hpp.
+typedef JSStatic<JSContextJSC, JSValueJSC, JSObjectJSC, JSArrayJSC> JSStaticJSC;
 
 } // namespace jsobjects
 
@@ -0,0 +1,175 @@
+#ifndef JSOBJECTS_JSC_POOL_HPP
+#define JSOBJECTS_JSC_POOL_HPP
+
+#include "jsobjects_jsc.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace jsobjects {
+
+/**
+ * Creates and reuses JSC global contexts for independent workloads.
+ *
+ * A worker thread leases a context for as long as it needs one, either
+ * explicitly (JSContextPoolJSC::Lease) or for a single job (run()).
+ * Further callers block until a context becomes available.
+ * Unless disabled, a context is replaced by a fresh one when it is returned,
+ * i.e., globals defined by one job are not visible to the next.
+ *
+ *     JSContextPoolJSC pool(4);
+ *     // from any thread
+ *     pool.run(job);    // calls job(JSContextJSC&)
+ *
+ * Note: values created through a leased context should be released
+ *   before the lease ends. They keep their global context alive (see
+ *   JSContextDataJSC), but it is replaced or leased to another thread then.
+ *
+ * Note: contexts in the same context group share one virtual machine,
+ *   which JSC locks for every call. Only contexts in separate groups
+ *   (the default) run concurrently; sharing a group allows passing
+ *   values between the pooled contexts.
+ */
+class JSContextPoolJSC {
+
+public:
+
+  JSContextPoolJSC(size_t size, bool shareGroup = false, bool resetOnRelease = true)
+    : slots(size), group(0), resetOnRelease(resetOnRelease) {
+    if(shareGroup) {
+      group = JSContextGroupCreate();
+    }
+    for(size_t idx = 0; idx < size; ++idx) {
+      Slot& slot = slots[idx];
+      slot.group = (group != 0) ? JSContextGroupRetain(group) : JSContextGroupCreate();
+      slot.context = 0;
+      _Create(slot);
+      available.push_back(idx);
+    }
+  }
+
+  // Note: all leases must have been returned
+  ~JSContextPoolJSC() {
+    for(size_t idx = 0; idx < slots.size(); ++idx) {
+      _Destroy(slots[idx]);
+      JSContextGroupRelease(slots[idx].group);
+    }
+    if(group != 0) {
+      JSContextGroupRelease(group);
+    }
+  }
+
+  size_t size() const {
+    return slots.size();
+  }
+
+  // Reserves a context for the current thread.
+  class Lease {
+
+  public:
+
+    Lease(JSContextPoolJSC& pool): pool(pool), previous(_Current()) {
+      index = pool._Acquire();
+      _Current() = &pool.slots[index].jscontext;
+    }
+
+    ~Lease() {
+      _Current() = previous;
+      pool._Release(index);
+    }
+
+    JSContextJSC& getContext() {
+      return *pool.slots[index].jscontext;
+    }
+
+    JSContextPtr getContextPtr() {
+      return pool.slots[index].jscontext;
+    }
+
+  private:
+
+    JSContextPoolJSC& pool;
+    size_t index;
+    boost::shared_ptr<JSContextJSC>* previous;
+
+    Lease(const Lease&);
+    Lease& operator=(const Lease&);
+  };
+
+  template <class Job>
+  void run(Job job) {
+    Lease lease(*this);
+    job(lease.getContext());
+  }
+
+  // The context leased by the current thread, 0 if there is none.
+  static boost::shared_ptr<JSContextJSC> GetContext() {
+    boost::shared_ptr<JSContextJSC>* current = _Current();
+    if(current == 0) return boost::shared_ptr<JSContextJSC>();
+    return *current;
+  }
+
+private:
+
+  struct Slot {
+    JSContextGroupRef group;
+    JSGlobalContextRef context;
+    boost::shared_ptr<JSContextJSC> jscontext;
+  };
+
+  static boost::shared_ptr<JSContextJSC>*& _Current() {
+    static thread_local boost::shared_ptr<JSContextJSC>* current = 0;
+    return current;
+  }
+
+  void _Create(Slot& slot) {
+    slot.context = JSGlobalContextCreateInGroup(slot.group, 0);
+    slot.jscontext.reset(new JSContextJSC(slot.context));
+  }
+
+  void _Destroy(Slot& slot) {
+    // Note: the wrapper holds a reference on the global context, too
+    slot.jscontext.reset();
+    JSGlobalContextRelease(slot.context);
+    slot.context = 0;
+  }
+
+  size_t _Acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(available.empty()) {
+      released.wait(lock);
+    }
+    size_t index = available.back();
+    available.pop_back();
+    return index;
+  }
+
+  void _Release(size_t index) {
+    if(resetOnRelease) {
+      Slot& slot = slots[index];
+      _Destroy(slot);
+      _Create(slot);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      available.push_back(index);
+    }
+    released.notify_one();
+  }
+
+  std::vector<Slot> slots;
+  JSContextGroupRef group;
+  bool resetOnRelease;
+
+  std::mutex mutex;
+  std::condition_variable released;
+  std::vector<size_t> available;
+
+  JSContextPoolJSC(const JSContextPoolJSC&);
+  JSContextPoolJSC& operator=(const JSContextPoolJSC&);
+};
+
+} // namespace jsobjects
+
+#endif // JSOBJECTS_JSC_POOL_HPP
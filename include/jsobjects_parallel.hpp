@@ -0,0 +1,449 @@
+#ifndef JSOBJECTS_PARALLEL_HPP
+#define JSOBJECTS_PARALLEL_HPP
+
+#include "jsobjects_cpp.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace jsobjects {
+
+/**
+ * A fixed set of worker threads which balance their load by work stealing.
+ *
+ * Each worker has its own deque of tasks: it runs its own tasks newest
+ * first and, when it has none left, steals the oldest task of another
+ * worker. Tasks submitted by a worker go to its own deque, tasks submitted
+ * by other threads are distributed round-robin.
+ *
+ *     JSThreadPool pool;    // one worker per core
+ *     pool.submit(task);    // from any thread
+ *
+ * Threads which wait for tasks (see JSParallelFor()) run pending tasks
+ * meanwhile, so that parallel calls can be nested.
+ *
+ * Note: tasks must not throw. Pending tasks are run before the pool is destroyed.
+ */
+class JSThreadPool {
+
+public:
+
+  typedef std::function<void ()> Task;
+
+  explicit JSThreadPool(size_t size = std::thread::hardware_concurrency())
+    : workers(std::max<size_t>(size, 1)), pending(0), next(0), stopping(false) {
+    for(size_t idx = 0; idx < workers.size(); ++idx) {
+      threads.push_back(std::thread(&JSThreadPool::_Run, this, idx));
+    }
+  }
+
+  ~JSThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeup.notify_all();
+    for(size_t idx = 0; idx < threads.size(); ++idx) {
+      threads[idx].join();
+    }
+  }
+
+  size_t size() const {
+    return workers.size();
+  }
+
+  // Thread-safe.
+  void submit(const Task& task) {
+    size_t index = _IsWorker() ? _Current().second : next++ % workers.size();
+    {
+      // Note: counted under the lock that queues it, i.e., idle workers do not
+      //   see a task before they can pop it, and it can not be missed when waiting
+      std::lock_guard<std::mutex> lock(mutex);
+      std::lock_guard<std::mutex> queue(workers[index].mutex);
+      workers[index].tasks.push_back(task);
+      ++pending;
+    }
+    wakeup.notify_one();
+  }
+
+  // Runs one pending task on the calling thread and returns false if there was none.
+  bool runPending() {
+    Task task;
+    if(!_Pop(task)) return false;
+    task();
+    return true;
+  }
+
+private:
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // The pool and index of the worker running on the current thread.
+  static std::pair<JSThreadPool*, size_t>& _Current() {
+    static thread_local std::pair<JSThreadPool*, size_t> current(0, 0);
+    return current;
+  }
+
+  bool _IsWorker() {
+    return _Current().first == this;
+  }
+
+  void _Run(size_t index) {
+    _Current() = std::make_pair(this, index);
+    Task task;
+    while(true) {
+      if(_Pop(task)) {
+        task();
+        task = Task();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex);
+      if(stopping && pending == 0) return;
+      wakeup.wait(lock, [this]() { return stopping || pending > 0; });
+    }
+  }
+
+  bool _Pop(Task& task) {
+    size_t count = workers.size();
+    size_t first;
+    if(_IsWorker()) {
+      first = _Current().second;
+      Worker& own = workers[first];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if(!own.tasks.empty()) {
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        --pending;
+        return true;
+      }
+    } else {
+      first = next.load(std::memory_order_relaxed);
+    }
+    for(size_t idx = 1; idx <= count; ++idx) {
+      Worker& victim = workers[(first + idx) % count];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if(!victim.tasks.empty()) {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        --pending;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<Worker> workers;
+  std::vector<std::thread> threads;
+
+  std::atomic<size_t> pending;
+  std::atomic<size_t> next;
+  bool stopping;
+
+  std::mutex mutex;
+  std::condition_variable wakeup;
+
+  JSThreadPool(const JSThreadPool&);
+  JSThreadPool& operator=(const JSThreadPool&);
+};
+
+/**
+ * Counts down the tasks of one parallel call and keeps the first exception.
+ */
+class JSTaskGroup {
+
+public:
+
+  JSTaskGroup(size_t count): remaining(count) {}
+
+  template <class F>
+  void run(F f) {
+    try {
+      f();
+    } catch(...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(!error) error = std::current_exception();
+    }
+    // Note: notifies under the lock, as the group is gone as soon as wait() returns
+    std::lock_guard<std::mutex> lock(mutex);
+    if(--remaining == 0) done.notify_all();
+  }
+
+  // Runs pending tasks of the pool until all tasks of this group have finished.
+  // Rethrows the first exception of the tasks.
+  void wait(JSThreadPool& pool) {
+    while(!_Finished()) {
+      // Note: if there is nothing to run, all tasks of this group have been started
+      if(!pool.runPending()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return remaining == 0; });
+      }
+    }
+    if(error) std::rethrow_exception(error);
+  }
+
+private:
+
+  bool _Finished() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return remaining == 0;
+  }
+
+  size_t remaining;
+  std::exception_ptr error;
+
+  std::mutex mutex;
+  std::condition_variable done;
+
+  JSTaskGroup(const JSTaskGroup&);
+  JSTaskGroup& operator=(const JSTaskGroup&);
+};
+
+// The size of the chunks [0, length) is split into; with 'grain' 0 about
+// eight chunks per worker, so that stealing can even out their costs.
+inline unsigned int JSParallelGrain(JSThreadPool& pool, unsigned int length, unsigned int grain) {
+  if(grain > 0) return grain;
+  size_t chunks = pool.size() * 8;
+  return std::max<size_t>(64, (length + chunks - 1) / chunks);
+}
+
+/**
+ * Calls f(begin, end) for the chunks of the index range [0, length) on the
+ * pool and returns when all have finished. The calling thread runs pending
+ * tasks meanwhile.
+ *
+ *     JSParallelFor(pool, length, [&](unsigned int begin, unsigned int end) {
+ *       for(unsigned int idx = begin; idx < end; ++idx) { ... }
+ *     });
+ *
+ * The first exception thrown by 'f' is rethrown after all chunks have finished.
+ */
+template <class F>
+void JSParallelFor(JSThreadPool& pool, unsigned int length, F f, unsigned int grain = 0) {
+  if(length == 0) return;
+  grain = JSParallelGrain(pool, length, grain);
+  unsigned int chunks = (length - 1) / grain + 1;
+  if(chunks == 1) {
+    f(0u, length);
+    return;
+  }
+  JSTaskGroup group(chunks);
+  for(unsigned int chunk = 0; chunk < chunks; ++chunk) {
+    unsigned int begin = chunk * grain;
+    unsigned int end = (chunk + 1 < chunks) ? begin + grain : length;
+    pool.submit([&group, &f, begin, end]() {
+      group.run([&f, begin, end]() { f(begin, end); });
+    });
+  }
+  group.wait(pool);
+}
+
+/**
+ * Parallel algorithms over the elements of JSArrayCpp arrays.
+ *
+ * The index range is split into chunks (see JSParallelFor()). The elements
+ * are read directly, i.e., without calls of getAt(), and each chunk writes
+ * its own part of the result, so that workers contend for nothing but the
+ * tasks:
+ *
+ *     JSThreadPool pool;
+ *     JSArrayPtr names = JSParallelCpp::map(pool, *records, [](JSValue& rec, unsigned int idx) {
+ *       return rec.asObject()->get("name");
+ *     });
+ *
+ * The callbacks are called concurrently. They may read the elements but
+ * must not modify them or the array. Empty elements are skipped, i.e., the
+ * callbacks are not called for them and map() leaves their results empty.
+ *
+ * Note: the arrays must have been created by a JSContextCpp.
+ */
+struct JSParallelCpp {
+
+  // Calls f(JSValue& val, unsigned int idx) for each element.
+  template <class F>
+  static void forEach(JSThreadPool& pool, JSArray& arr, F f, unsigned int grain = 0) {
+    std::vector<JSValuePtr>& vector = _Elements(arr);
+    JSParallelFor(pool, vector.size(), [&vector, &f](unsigned int begin, unsigned int end) {
+      for(unsigned int idx = begin; idx < end; ++idx) {
+        if(vector[idx]) f(*vector[idx], idx);
+      }
+    }, grain);
+  }
+
+  // Creates an array of the results of f(JSValue& val, unsigned int idx) -> JSValuePtr.
+  template <class F>
+  static JSArrayPtr map(JSThreadPool& pool, JSArray& arr, F f, unsigned int grain = 0) {
+    std::vector<JSValuePtr>& vector = _Elements(arr);
+    JSValueCpp::DataPtr data(new JSValueCpp::_Data());
+    std::vector<JSValuePtr>& result = data->vector;
+    result.resize(vector.size());
+    JSParallelFor(pool, vector.size(), [&vector, &result, &f](unsigned int begin, unsigned int end) {
+      for(unsigned int idx = begin; idx < end; ++idx) {
+        if(vector[idx]) result[idx] = f(*vector[idx], idx);
+      }
+    }, grain);
+    // Note: links the results to the array (see JSValueCpp::clone())
+    for(size_t idx = 0; idx < result.size(); ++idx) {
+      if(result[idx]) result[idx] = JSValueCpp::_Adopt(data.get(), result[idx]);
+    }
+    return JSArrayPtr(new JSArrayCpp(data));
+  }
+
+  // Creates an array of the elements for which f(JSValue& val, unsigned int idx) is true,
+  // in their order. Note: the elements are shared, not copied
+  template <class F>
+  static JSArrayPtr filter(JSThreadPool& pool, JSArray& arr, F f, unsigned int grain = 0) {
+    JSArrayCpp& array = JSStaticCpp::array(arr);
+    std::vector<JSValuePtr>& vector = _Elements(arr);
+    unsigned int length = vector.size();
+    grain = JSParallelGrain(pool, length, grain);
+    std::vector< std::vector<JSValuePtr> > parts((length + grain - 1) / grain);
+    JSParallelFor(pool, length, [&](unsigned int begin, unsigned int end) {
+      std::vector<JSValuePtr>& part = parts[begin / grain];
+      for(unsigned int idx = begin; idx < end; ++idx) {
+        if(vector[idx] && f(*vector[idx], idx)) part.push_back(vector[idx]);
+      }
+    }, grain);
+
+    std::vector<size_t> offsets(parts.size() + 1, 0);
+    for(size_t idx = 0; idx < parts.size(); ++idx) {
+      offsets[idx + 1] = offsets[idx] + parts[idx].size();
+    }
+    JSValueCpp::DataPtr data(new JSValueCpp::_Data());
+    std::vector<JSValuePtr>& result = data->vector;
+    result.resize(offsets.back());
+    JSParallelFor(pool, parts.size(), [&](unsigned int begin, unsigned int end) {
+      for(unsigned int idx = begin; idx < end; ++idx) {
+        std::move(parts[idx].begin(), parts[idx].end(), result.begin() + offsets[idx]);
+      }
+    }, 1);
+    // Note: the elements which a clone borrows are borrowed by the result, too
+    if(array.step || array.data->borrowing) {
+      for(size_t idx = 0; idx < result.size(); ++idx) {
+        if(array._Borrows(result[idx])) JSValueCpp::_Lend(data.get(), result[idx]);
+      }
+      data->borrowing = true;
+    }
+    return JSArrayPtr(new JSArrayCpp(data));
+  }
+
+  // Folds the elements with f(T acc, JSValue& val, unsigned int idx) -> T per chunk,
+  // starting with 'init', and the results of the chunks with combine(T, T) -> T in order.
+  // Note: 'init' must be neutral for 'combine', e.g., 0 for a sum
+  template <class T, class F, class C>
+  static T reduce(JSThreadPool& pool, JSArray& arr, const T& init, F f, C combine, unsigned int grain = 0) {
+    std::vector<JSValuePtr>& vector = _Elements(arr);
+    unsigned int length = vector.size();
+    if(length == 0) return init;
+    grain = JSParallelGrain(pool, length, grain);
+    std::vector<T> partials((length + grain - 1) / grain, init);
+    JSParallelFor(pool, length, [&](unsigned int begin, unsigned int end) {
+      // Note: accumulates locally, as the partials of neighbouring chunks share cache lines
+      T acc = init;
+      for(unsigned int idx = begin; idx < end; ++idx) {
+        if(vector[idx]) acc = f(acc, *vector[idx], idx);
+      }
+      partials[begin / grain] = acc;
+    }, grain);
+    T result = partials[0];
+    for(size_t idx = 1; idx < partials.size(); ++idx) {
+      result = combine(result, partials[idx]);
+    }
+    return result;
+  }
+
+  // Sorts the array in place by less(JSValue& a, JSValue& b) -> bool, empty elements last.
+  // The sort is stable: the chunks are sorted in parallel and then merged
+  // pairwise, where every merge is split at equal output positions.
+  template <class Compare>
+  static void sort(JSThreadPool& pool, JSArray& arr, Compare less, unsigned int grain = 0) {
+    JSArrayCpp& array = JSStaticCpp::array(arr);
+    array._Modify();
+    std::vector<JSValuePtr>& vector = array.data->vector;
+    unsigned int length = vector.size();
+    if(length < 2) return;
+    grain = JSParallelGrain(pool, length, grain);
+
+    // Note: sorts pointers to the elements, as they are read by several
+    //   chunks at a time during the merges, and moves them only at the end
+    typedef JSValuePtr* Ref;
+    auto compare = [&less](Ref a, Ref b) { return *a && (!*b || less(**a, **b)); };
+    std::vector<Ref> refs(length);
+    JSParallelFor(pool, length, [&](unsigned int begin, unsigned int end) {
+      for(unsigned int idx = begin; idx < end; ++idx) {
+        refs[idx] = &vector[idx];
+      }
+      std::stable_sort(refs.begin() + begin, refs.begin() + end, compare);
+    }, grain);
+
+    std::vector<Ref> buffer(length);
+    for(size_t width = grain; width < length; width *= 2) {
+      JSParallelFor(pool, length, [&](unsigned int begin, unsigned int end) {
+        for(size_t lo = begin - begin % (2 * width); lo < end; lo += 2 * width) {
+          size_t mid = std::min<size_t>(lo + width, length);
+          size_t hi = std::min<size_t>(lo + 2 * width, length);
+          _Merge(&refs[lo], mid - lo, &refs[mid], hi - mid,
+                 std::max<size_t>(begin, lo) - lo, std::min<size_t>(end, hi) - lo,
+                 &buffer[lo], compare);
+        }
+      }, grain);
+      refs.swap(buffer);
+    }
+
+    std::vector<JSValuePtr> sorted(length);
+    JSParallelFor(pool, length, [&](unsigned int begin, unsigned int end) {
+      for(unsigned int idx = begin; idx < end; ++idx) {
+        sorted[idx] = std::move(*refs[idx]);
+      }
+    }, grain);
+    vector.swap(sorted);
+  }
+
+private:
+
+  static std::vector<JSValuePtr>& _Elements(JSArray& arr) {
+    JSArrayCpp& array = JSStaticCpp::array(arr);
+    array._Sync();
+    return array.data->vector;
+  }
+
+  // Writes the outputs [from, to) of the stable merge of 'a' and 'b'.
+  template <class T, class Compare>
+  static void _Merge(const T* a, size_t na, const T* b, size_t nb, size_t from, size_t to, T* out, Compare compare) {
+    size_t aFrom = _Split(a, na, b, nb, from, compare);
+    size_t aTo = _Split(a, na, b, nb, to, compare);
+    std::merge(a + aFrom, a + aTo, b + (from - aFrom), b + (to - aTo), out + from, compare);
+  }
+
+  // The number of elements of 'a' among the first 'pos' outputs of the merge,
+  // i.e., the position where the merge path crosses the diagonal 'pos'.
+  template <class T, class Compare>
+  static size_t _Split(const T* a, size_t na, const T* b, size_t nb, size_t pos, Compare compare) {
+    size_t lo = (pos > nb) ? pos - nb : 0;
+    size_t hi = std::min(pos, na);
+    while(lo < hi) {
+      size_t i = lo + (hi - lo) / 2;
+      // on ties the elements of 'a' come first
+      if(!compare(b[pos - i - 1], a[i])) {
+        lo = i + 1;
+      } else {
+        hi = i;
+      }
+    }
+    return lo;
+  }
+};
+
+} // namespace jsobjects
+
+#endif // JSOBJECTS_PARALLEL_HPP
@@ -0,0 +1,173 @@
+#ifndef JSOBJECTS_QUEUE_HPP
+#define JSOBJECTS_QUEUE_HPP
+
+#include "jsobjects.hpp"
+
+#include <atomic>
+#include <functional>
+#include <utility>
+
+namespace jsobjects {
+
+/**
+ * A lock-free multi-producer/single-consumer queue.
+ *
+ * push() may be called from any thread, pop() only from one thread at a time.
+ * Producers link a new node with a single atomic exchange, i.e., they never
+ * wait for each other or for the consumer.
+ *
+ * Note: after D. Vyukov's node-based MPSC queue; the consumer keeps the last
+ *   dequeued node as stub, so 'T' must be default constructible.
+ */
+template <typename T>
+class JSQueue {
+
+public:
+
+  JSQueue() {
+    Node* stub = new Node();
+    head.store(stub, std::memory_order_relaxed);
+    tail = stub;
+  }
+
+  ~JSQueue() {
+    while(tail != 0) {
+      Node* next = tail->next.load(std::memory_order_relaxed);
+      delete tail;
+      tail = next;
+    }
+  }
+
+  void push(const T& value) {
+    Node* node = new Node(value);
+    Node* previous = head.exchange(node, std::memory_order_acq_rel);
+    // Note: until this store, the consumer sees the queue ending at 'previous'
+    previous->next.store(node, std::memory_order_release);
+  }
+
+  // Returns false if the queue is empty (or a push is not complete yet).
+  bool pop(T& value) {
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if(next == 0) return false;
+    value = std::move(next->value);
+    delete tail;
+    tail = next;
+    return true;
+  }
+
+private:
+
+  struct Node {
+    Node(): next(0) {}
+    Node(const T& value): next(0), value(value) {}
+
+    std::atomic<Node*> next;
+    T value;
+  };
+
+  // the most recently pushed node
+  std::atomic<Node*> head;
+  // the stub node; its successor is the next to be popped
+  Node* tail;
+
+  JSQueue(const JSQueue&);
+  JSQueue& operator=(const JSQueue&);
+};
+
+// Copies a value (e.g., created by a JSContextCpp) into the given context.
+inline JSValuePtr JSCopyValue(JSContext& context, JSValue& val) {
+  switch(val.getType()) {
+  case JSValue::Null:
+    return context.null();
+  case JSValue::Undefined:
+    return context.undefined();
+  case JSValue::Boolean:
+    return context.newBoolean(val.asBool());
+  case JSValue::Number:
+    return context.newNumber(val.asDouble());
+  case JSValue::String:
+    return context.newString(val.asString());
+  case JSValue::Array: {
+    JSArrayPtr arr = val.asArray();
+    unsigned int length = arr->length();
+    JSArrayPtr result = context.newArray(length);
+    for(unsigned int idx = 0; idx < length; ++idx) {
+      result->setAt(idx, JSCopyValue(context, *arr->getAt(idx)));
+    }
+    return result->toValue(result);
+  }
+  case JSValue::Object: {
+    JSObjectPtr result = context.newObject();
+    val.asObject()->forEach([&context, &result](const JSStringView& key, JSValue& value) {
+      result->set(key, JSCopyValue(context, value));
+    });
+    return result->toValue(result);
+  }
+  }
+  throw "Not supported";
+}
+
+inline JSValuePtr JSCopyValue(JSContext& context, const JSValuePtr& val) {
+  return JSCopyValue(context, *val);
+}
+
+/**
+ * Hands results of worker threads over to the thread owning a context.
+ *
+ * Workers post closures or (JSValueCpp) results with a callback; the owning
+ * thread calls drain() regularly, which runs the pending completions in
+ * order of their arrival per worker. Results are copied into the context
+ * before the callback is called.
+ *
+ *     // worker thread
+ *     queue.post(result, [](JSValuePtr val) { ... });
+ *     // owning thread
+ *     queue.drain();
+ *
+ * Note: a worker must not use a posted value anymore.
+ */
+class JSCompletionQueue {
+
+public:
+
+  typedef std::function<void (JSContext&)> Closure;
+  typedef std::function<void (JSValuePtr)> Callback;
+
+  JSCompletionQueue(JSContext& context): context(context) {}
+
+  // Thread-safe.
+  void post(const Closure& closure) {
+    queue.push(closure);
+  }
+
+  // Thread-safe.
+  void post(const JSValuePtr& result, const Callback& callback) {
+    queue.push([result, callback](JSContext& context) {
+      callback(JSCopyValue(context, result));
+    });
+  }
+
+  // Runs at most 'max' pending completions and returns how many were run.
+  // Must be called by the thread owning the context.
+  size_t drain(size_t max = static_cast<size_t>(-1)) {
+    size_t count = 0;
+    Closure closure;
+    while(count < max && queue.pop(closure)) {
+      closure(context);
+      ++count;
+    }
+    return count;
+  }
+
+private:
+
+  JSContext& context;
+  JSQueue<Closure> queue;
+
+  JSCompletionQueue(const JSCompletionQueue&);
+  JSCompletionQueue& operator=(const JSCompletionQueue&);
+};
+
+} // namespace jsobjects
+
+#endif // JSOBJECTS_QUEUE_HPP
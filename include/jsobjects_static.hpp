@@ -0,0 +1,189 @@
+#ifndef JSOBJECTS_STATIC_HPP
+#define JSOBJECTS_STATIC_HPP
+
+#include "jsobjects.hpp"
+
+namespace jsobjects {
+
+/**
+ * Compile-time access to the implementation of a backend.
+ *
+ * Each backend provides an instance (e.g., JSStaticCpp). Code written against
+ * such a type parameter calls the backend methods directly, i.e., without
+ * going through the vtable, so that they can be inlined:
+ *
+ *     template <class B>
+ *     double sum(JSArray& arr) {
+ *       typename B::Array& a = B::array(arr);
+ *       double result = 0;
+ *       for(unsigned int idx = 0; idx < B::length(a); ++idx) {
+ *         result += B::asDouble(B::value(B::getAt(a, idx)));
+ *       }
+ *       return result;
+ *     }
+ *
+ *     sum<JSStaticCpp>(*arr);
+ *
+ * The downcasts use JSValue::getImpl() instead of RTTI, and the methods
+ * are called qualified (e.g., obj.Object::get(key)), which binds them statically.
+ *
+ * Note: the casts require that the value has been created by the given backend.
+ */
+template <class C, class V, class O, class A>
+struct JSStatic {
+
+  typedef C Context;
+  typedef V Value;
+  typedef O Object;
+  typedef A Array;
+
+  // Casts
+
+  static Value& value(JSValue& val) {
+    return *static_cast<Value*>(val.getImpl());
+  }
+
+  static Value& value(const JSValuePtr& val) {
+    return value(*val);
+  }
+
+  static Object& object(JSValue& val) {
+    return static_cast<Object&>(value(val));
+  }
+
+  static Object& object(const JSObjectPtr& obj) {
+    return object(*obj);
+  }
+
+  static Array& array(JSValue& val) {
+    return static_cast<Array&>(value(val));
+  }
+
+  static Array& array(const JSArrayPtr& arr) {
+    return array(*arr);
+  }
+
+  // Values
+
+  static JSValue::JSValueType getType(Value& val) {
+    return val.Value::getType();
+  }
+
+  static double asDouble(Value& val) {
+    return val.Value::asDouble();
+  }
+
+  static bool asBool(Value& val) {
+    return val.Value::asBool();
+  }
+
+  static std::string asString(Value& val) {
+    return val.Value::asString();
+  }
+
+  static void asString(Value& val, std::string& result) {
+    val.Value::asString(result);
+  }
+
+  // Objects
+
+  static JSValuePtr get(Object& obj, const JSStringView& key) {
+    return obj.Object::get(key);
+  }
+
+  static void set(Object& obj, const JSStringView& key, JSValuePtr val) {
+    obj.Object::set(key, val);
+  }
+
+  static void set(Object& obj, const JSStringView& key, const std::string& val) {
+    obj.Object::set(key, val);
+  }
+
+  static void set(Object& obj, const JSStringView& key, const char* val) {
+    obj.Object::set(key, val);
+  }
+
+  static void set(Object& obj, const JSStringView& key, std::string&& val) {
+    obj.Object::set(key, std::move(val));
+  }
+
+  static void set(Object& obj, const JSStringView& key, bool val) {
+    obj.Object::set(key, val);
+  }
+
+  static void set(Object& obj, const JSStringView& key, double val) {
+    obj.Object::set(key, val);
+  }
+
+  static StrVector getKeys(Object& obj) {
+    return obj.Object::getKeys();
+  }
+
+  static void forEach(Object& obj, JSPropertyVisitor& visitor) {
+    obj.Object::forEach(visitor);
+  }
+
+  // Arrays
+
+  static unsigned int length(Array& arr) {
+    return arr.Array::length();
+  }
+
+  static JSValuePtr getAt(Array& arr, unsigned int index) {
+    return arr.Array::getAt(index);
+  }
+
+  static void setAt(Array& arr, unsigned int index, JSValuePtr val) {
+    arr.Array::setAt(index, val);
+  }
+
+  static void setAt(Array& arr, unsigned int index, const std::string& val) {
+    arr.Array::setAt(index, val);
+  }
+
+  static void setAt(Array& arr, unsigned int index, const char* val) {
+    arr.Array::setAt(index, val);
+  }
+
+  static void setAt(Array& arr, unsigned int index, std::string&& val) {
+    arr.Array::setAt(index, std::move(val));
+  }
+
+  static void setAt(Array& arr, unsigned int index, bool val) {
+    arr.Array::setAt(index, val);
+  }
+
+  static void setAt(Array& arr, unsigned int index, double val) {
+    arr.Array::setAt(index, val);
+  }
+
+  // Context
+
+  static JSValuePtr newString(Context& context, const std::string& val) {
+    return context.Context::newString(val);
+  }
+
+  static JSValuePtr newString(Context& context, std::string&& val) {
+    return context.Context::newString(std::move(val));
+  }
+
+  static JSValuePtr newBoolean(Context& context, bool val) {
+    return context.Context::newBoolean(val);
+  }
+
+  static JSValuePtr newNumber(Context& context, double val) {
+    return context.Context::newNumber(val);
+  }
+
+  static JSObjectPtr newObject(Context& context) {
+    return context.Context::newObject();
+  }
+
+  static JSArrayPtr newArray(Context& context, unsigned int length) {
+    return context.Context::newArray(length);
+  }
+};
+
+} // namespace jsobjects
+
+#endif // JSOBJECTS_STATIC_HPP
@@ -2,62 +2,124 @@
 #define JSOBJECTS_V8_HPP
 
 #include "jsobjects.hpp"
+#include "jsobjects_static.hpp"
 
 #include <v8.h>
 #include <assert.h>
+#include <string.h>
+#include <exception>
 #include <iostream>
 
+#include <boost/weak_ptr.hpp>
+
 namespace jsobjects {
 
+class JSContextV8;
+class JSContextDataV8;
+class JSScopeV8;
+
+typedef boost::shared_ptr<JSContextDataV8> JSContextDataV8Ptr;
+
 void JSObjectsV8_MakeWeakCallback(v8::Persistent<v8::Value> object, void* parameter) {}
 
-std::string JSValueV8_toString(const v8::Handle<v8::Value> val) {
+// Writes the UTF-8 representation of a value into 'result' reusing its buffer.
+inline void JSValueV8_toString(const v8::Handle<v8::Value> val, std::string& result) {
   v8::Handle<v8::String> jsstring = val->ToString();
-  int buflen = jsstring->Utf8Length()+1;
-  char *cstr = new char[buflen];
-  jsstring->WriteUtf8(cstr, buflen);
-  cstr[buflen-1] = 0;
-  std::string result(cstr);
-  delete[] cstr;
+  int len = jsstring->Utf8Length();
+  result.resize(len);
+  if(len > 0) {
+    jsstring->WriteUtf8(&result[0], len, 0, v8::String::NO_NULL_TERMINATION);
+  }
+}
+
+std::string JSValueV8_toString(const v8::Handle<v8::Value> val) {
+  std::string result;
+  JSValueV8_toString(val, result);
   return result;
 }
 
 v8::Handle<v8::String> JSValueV8_fromString(const std::string& s) {
-   return v8::String::New(s.c_str());
+   return v8::String::New(s.data(), s.size());
 }
 
-class JSValueV8: public virtual JSValue {
+// Called when V8 does not need memory handed over without copying anymore.
+typedef void (*JSExternalDisposeV8)(void* data, void* hint);
+
+// Lets V8 use a C++ owned ASCII buffer as string content.
+class JSExternalStringV8: public v8::String::ExternalAsciiStringResource {
 
 public:
 
-  JSValueV8(v8::Handle<v8::Value> val) {
+  JSExternalStringV8(const char* data, size_t length, JSExternalDisposeV8 dispose, void* hint)
+    : data_(data), length_(length), dispose(dispose), hint(hint) {}
 
-    if(val->IsNull()) {
-      type = Null;
-    } if(val->IsUndefined()) {
-      type = Undefined;
-    } else if(val->IsBoolean()) {
-      type = Boolean;
-    } else if(val->IsNumber()) {
-      type = Number;
-    } else if(val->IsString()) {
-      type = String;
-    } else if(val->IsArray()) {
-      type = Array;
-    } else if(val->IsObject()) {
-      type = Object;
-    } else {
-      throw "Not supported";
-    }
+  virtual ~JSExternalStringV8() {
+    if(dispose != 0) dispose(const_cast<char*>(data_), hint);
+  }
+
+  virtual const char* data() const { return data_; }
+
+  virtual size_t length() const { return length_; }
 
-    value = v8::Persistent<v8::Value>::New(val);
+private:
+
+  const char* data_;
+  size_t length_;
+  JSExternalDisposeV8 dispose;
+  void* hint;
+};
+
+// Keeps track of external array data until the owning object is collected.
+struct JSExternalArrayDataV8 {
+  void* data;
+  JSExternalDisposeV8 dispose;
+  void* hint;
+};
+
+inline void JSExternalArrayDataV8_WeakCallback(v8::Persistent<v8::Value> object, void* parameter) {
+  JSExternalArrayDataV8* external = static_cast<JSExternalArrayDataV8*>(parameter);
+  external->dispose(external->data, external->hint);
+  delete external;
+  object.Dispose();
+  object.Clear();
+}
+
+// Creates an array-like object using 'data' as element storage.
+// 'dispose' (if given) is called when the object has been garbage collected.
+inline v8::Handle<v8::Object> JSExternalArrayV8_New(void* data, v8::ExternalArrayType type,
+    unsigned int length, JSExternalDisposeV8 dispose, void* hint) {
+  v8::Handle<v8::Object> obj = v8::Object::New();
+  obj->SetIndexedPropertiesToExternalArrayData(data, type, length);
+  obj->Set(v8::String::NewSymbol("length"), v8::Integer::New(length));
+
+  if(dispose != 0) {
+    JSExternalArrayDataV8* external = new JSExternalArrayDataV8();
+    external->data = data;
+    external->dispose = dispose;
+    external->hint = hint;
+    v8::Persistent<v8::Value> weak = v8::Persistent<v8::Value>::New(obj);
+    weak.MakeWeak(external, JSExternalArrayDataV8_WeakCallback);
   }
+  return obj;
+}
+
+class JSValueV8: public virtual JSValue {
+
+public:
+
+  JSValueV8(v8::Handle<v8::Value> val, const JSContextDataV8Ptr& owner = JSContextDataV8Ptr())
+    : owner(owner), typeKnown(false), scope(0), scopeSlot(0), borrowed(false) {
+    // Note: the type is determined on demand (see getType())
+    // as most values are just passed through
+    _Retain(val);
+  }
+
+  // Note: uses the given handle as is, i.e., without a persistent handle
+  JSValueV8(v8::Handle<v8::Value> val, JSBorrowed)
+    : value(val), typeKnown(false), scope(0), scopeSlot(0), borrowed(true) {}
 
   virtual ~JSValueV8() {
-    value.MakeWeak(0, jsobjects::JSObjectsV8_MakeWeakCallback);
-    value.ClearWeak();
-    value.Dispose();
-    value.Clear();
+    _Release();
   }
 
   virtual std::string asString() {
@@ -65,6 +127,11 @@ public:
     return JSValueV8_toString(value);
   }
 
+  virtual void asString(std::string& result) {
+    assert(value->IsString());
+    JSValueV8_toString(value, result);
+  }
+
   virtual double asDouble() {
     assert(value->IsNumber());
     return value->NumberValue();
@@ -75,7 +142,10 @@ public:
     return value->BooleanValue();
   }
 
-  virtual JSValueType getType() { return type; }
+  virtual JSValueType getType() {
+    if(!typeKnown) _Classify();
+    return type;
+  }
 
   inline virtual JSObjectPtr toObject(JSArrayPtr arr);
 
@@ -83,168 +153,851 @@ public:
 
   inline virtual JSValuePtr toValue(JSObjectPtr obj);
 
+  virtual void* getImpl() {
+    return this;
+  }
+
   inline virtual JSArrayPtr asArray();
 
   inline virtual JSObjectPtr asObject();
 
 public:
 
-  v8::Persistent<v8::Value> value;
+  // a local handle while the value is held by a JSScopeV8,
+  // the persistent handle otherwise
+  v8::Handle<v8::Value> value;
+
+  // the state of the context wrapper this value has been created by (might be empty)
+  // Note: shared, as values may outlive the wrapper
+  JSContextDataV8Ptr owner;
 
 protected:
 
+  inline void _Retain(v8::Handle<v8::Value> val);
+  inline void _Release();
+
+  void _Classify() {
+    if(value->IsUndefined()) {
+      type = Undefined;
+    } else if(value->IsNull()) {
+      type = Null;
+    } else if(value->IsBoolean()) {
+      type = Boolean;
+    } else if(value->IsNumber()) {
+      type = Number;
+    } else if(value->IsString()) {
+      type = String;
+    } else if(value->IsArray()) {
+      type = Array;
+    } else if(value->IsObject()) {
+      type = Object;
+    } else {
+      throw "Not supported";
+    }
+    typeKnown = true;
+  }
+
   JSValueType type;
+  bool typeKnown;
+
+private:
+
+  friend class JSScopeV8;
+
+  v8::Persistent<v8::Value> persistent;
+
+  // the scope that keeps this value alive instead of a persistent handle
+  JSScopeV8* scope;
+  size_t scopeSlot;
+
+  bool borrowed;
+};
+
+// Downcasts a value of this backend without RTTI.
+inline JSValueV8* JSValueV8_cast(JSValue* val) {
+  return static_cast<JSValueV8*>(val->getImpl());
+}
+
+class JSPropertyKeyV8: public JSPropertyKey {
+
+public:
+
+  // Note: symbols are internalized strings, i.e. looked up by identity
+  JSPropertyKeyV8(const std::string& key) {
+    v8::HandleScope scope;
+    this->key = v8::Persistent<v8::String>::New(v8::String::NewSymbol(key.c_str(), key.size()));
+  }
+
+  virtual ~JSPropertyKeyV8() {
+    key.Dispose();
+    key.Clear();
+  }
+
+  virtual std::string getName() {
+    return JSValueV8_toString(key);
+  }
+
+  v8::Persistent<v8::String> key;
 };
 
 class JSObjectV8: public JSValueV8, public virtual JSObject {
 
 public:
-  JSObjectV8(v8::Handle<v8::Object> obj): JSValueV8(obj), object(obj) {}
+  JSObjectV8(v8::Handle<v8::Object> obj, const JSContextDataV8Ptr& owner = JSContextDataV8Ptr()): JSValueV8(obj, owner) {}
 
-  JSObjectV8(v8::Handle<v8::Value> val): JSValueV8(val) {
+  JSObjectV8(v8::Handle<v8::Value> val, const JSContextDataV8Ptr& owner = JSContextDataV8Ptr()): JSValueV8(val, owner) {
+    assert(value->IsObject());
+  }
+
+  JSObjectV8(v8::Handle<v8::Value> val, JSBorrowed borrowed): JSValueV8(val, borrowed) {
     assert(value->IsObject());
-    object = v8::Handle<v8::Object>::Cast(val);
   }
 
   virtual ~JSObjectV8() {}
 
-  virtual JSValuePtr get(const std::string& key) {
-    return JSValuePtr(new JSValueV8(object->Get(v8::String::New(key.c_str()))));
+  // Returns the element storage if this object is a Float64Array
+  // (i.e., has external double elements), 0 otherwise.
+  double* getFloat64Data(unsigned int* length = 0) {
+    if(!_object()->HasIndexedPropertiesInExternalArrayData()
+        || _object()->GetIndexedPropertiesExternalArrayDataType() != v8::kExternalDoubleArray) {
+      return 0;
+    }
+    if(length != 0) {
+      *length = _object()->GetIndexedPropertiesExternalArrayDataLength();
+    }
+    return static_cast<double*>(_object()->GetIndexedPropertiesExternalArrayData());
+  }
+
+  virtual JSValuePtr get(const JSStringView& key) {
+    return JSValuePtr(new JSValueV8(_object()->Get(v8::String::New(key.c_str(), key.size())), owner));
+  }
+
+  virtual void set(const JSStringView& key, JSValuePtr val) {
+    _object()->Set(v8::String::New(key.c_str(), key.size()), JSValueV8_cast(JSOBJECTS_PTR_GET(val))->value);
   }
 
-  virtual void set(const std::string& key, JSValuePtr val) {
-    object->Set(v8::String::New(key.c_str()), dynamic_cast<JSValueV8*>(JSOBJECTS_PTR_GET(val))->value);
+  virtual void set(const JSStringView& key, const std::string& val) {
+    _object()->Set(v8::String::New(key.c_str(), key.size()), JSValueV8_fromString(val));
   }
 
-  virtual void set(const std::string& key, const std::string& val) {
-    object->Set(v8::String::New(key.c_str()), v8::String::New(val.c_str()));
+  virtual void set(const JSStringView& key, const char* val) {
+    _object()->Set(v8::String::New(key.c_str(), key.size()), v8::String::New(val));
   }
 
-  virtual void set(const std::string& key, const char* val) {
-    object->Set(v8::String::New(key.c_str()), v8::String::New(val));
+  virtual void set(const JSStringView& key, std::string&& val) {
+    set(key, static_cast<const std::string&>(val));
   }
 
-  virtual void set(const std::string& key, bool val) {
-    object->Set(v8::String::New(key.c_str()), v8::Boolean::New(val));
+  virtual void set(const JSStringView& key, bool val) {
+    _object()->Set(v8::String::New(key.c_str(), key.size()), v8::Boolean::New(val));
   }
 
-  virtual void set(const std::string& key, double val) {
-    object->Set(v8::String::New(key.c_str()), v8::Number::New(val));
+  virtual void set(const JSStringView& key, double val) {
+    _object()->Set(v8::String::New(key.c_str(), key.size()), v8::Number::New(val));
   }
 
   virtual std::vector<std::string> getKeys() {
     std::vector<std::string> keys;
-    v8::Handle<v8::Array> arr = object->GetPropertyNames();
-    keys.reserve(arr->Length());
-    for(size_t i = 0; i<arr->Length(); ++i) {
-      keys.push_back(JSValueV8_toString(arr->Get(i)->ToString()));
+    v8::Handle<v8::Array> arr = _object()->GetPropertyNames();
+    keys.resize(arr->Length());
+    for(size_t i = 0; i<keys.size(); ++i) {
+      JSValueV8_toString(arr->Get(i), keys[i]);
     }
 
     return keys;
   }
 
+  virtual void forEach(JSPropertyVisitor& visitor) {
+    v8::HandleScope scope;
+    v8::Handle<v8::Array> names = _object()->GetPropertyNames();
+    uint32_t count = names->Length();
+    std::string key;
+    for(uint32_t idx = 0; idx < count; ++idx) {
+      v8::HandleScope elementScope;
+      v8::Handle<v8::Value> name = names->Get(idx);
+      JSValueV8_toString(name, key);
+      JSStackValue<JSValueV8> value;
+      visitor.visit(key, *value.init(_object()->Get(name), JSBorrowed()));
+    }
+  }
+
+  virtual JSValuePtr get(const JSPropertyKeyPtr& key) {
+    return JSValuePtr(new JSValueV8(_object()->Get(_key(key)), owner));
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, JSValuePtr val) {
+    _object()->Set(_key(key), JSValueV8_cast(JSOBJECTS_PTR_GET(val))->value);
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, const std::string& val) {
+    _object()->Set(_key(key), v8::String::New(val.c_str(), val.size()));
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, const char* val) {
+    _object()->Set(_key(key), v8::String::New(val));
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, bool val) {
+    _object()->Set(_key(key), v8::Boolean::New(val));
+  }
+
+  virtual void set(const JSPropertyKeyPtr& key, double val) {
+    _object()->Set(_key(key), v8::Number::New(val));
+  }
+
+  virtual JSValuePtr call(const std::vector<JSValuePtr>& args) {
+    enum { ARGS = 8 };
+    v8::Handle<v8::Value> fixed[ARGS];
+    std::vector< v8::Handle<v8::Value> > dynamic;
+    v8::Handle<v8::Value>* argv = fixed;
+    if(args.size() > ARGS) {
+      dynamic.resize(args.size());
+      argv = &dynamic[0];
+    }
+    for(size_t idx = 0; idx < args.size(); ++idx) {
+      argv[idx] = JSValueV8_cast(JSOBJECTS_PTR_GET(args[idx]))->value;
+    }
+    // Note: no HandleScope here, as a scoped result needs a handle outliving this call
+    v8::Handle<v8::Value> result = _object()->CallAsFunction(v8::Context::GetCurrent()->Global(), args.size(), argv);
+    if(result.IsEmpty()) result = v8::Undefined();
+    return JSValuePtr(new JSValueV8(result, owner));
+  }
+
+  // Note: one HandleScope per element bounds the number of local handles
+  //   without allocating anything per call
+  virtual void callEach(JSArrayPtr args, JSArrayPtr results) {
+    v8::HandleScope handleScope;
+    v8::Handle<v8::Object> function = _object();
+    v8::Handle<v8::Object> receiver = v8::Context::GetCurrent()->Global();
+    v8::Handle<v8::Object> argsObj = v8::Handle<v8::Object>::Cast(JSValueV8_cast(JSOBJECTS_PTR_GET(args))->value);
+    v8::Handle<v8::Object> resultsObj = v8::Handle<v8::Object>::Cast(JSValueV8_cast(JSOBJECTS_PTR_GET(results))->value);
+    unsigned int length = args->length();
+    v8::Handle<v8::Value> argv[2];
+    for(unsigned int idx = 0; idx < length; ++idx) {
+      v8::HandleScope elementScope;
+      argv[0] = argsObj->Get(idx);
+      argv[1] = v8::Integer::New(idx);
+      _SetResult(resultsObj, idx, function->CallAsFunction(receiver, 2, argv));
+    }
+  }
+
+  virtual void callEach(const std::vector<JSValuePtr>& args, JSArrayPtr results) {
+    v8::HandleScope handleScope;
+    v8::Handle<v8::Object> function = _object();
+    v8::Handle<v8::Object> receiver = v8::Context::GetCurrent()->Global();
+    v8::Handle<v8::Object> resultsObj = v8::Handle<v8::Object>::Cast(JSValueV8_cast(JSOBJECTS_PTR_GET(results))->value);
+    v8::Handle<v8::Value> argv[2];
+    for(size_t idx = 0; idx < args.size(); ++idx) {
+      v8::HandleScope elementScope;
+      argv[0] = JSValueV8_cast(JSOBJECTS_PTR_GET(args[idx]))->value;
+      argv[1] = v8::Integer::New(idx);
+      _SetResult(resultsObj, idx, function->CallAsFunction(receiver, 2, argv));
+    }
+  }
+
 protected:
-  v8::Handle<v8::Object> object;
+
+  static const v8::Persistent<v8::String>& _key(const JSPropertyKeyPtr& key) {
+    return static_cast<JSPropertyKeyV8*>(JSOBJECTS_PTR_GET(key))->key;
+  }
+
+  // Note: a call that threw yields an empty handle, which is stored as undefined
+  static void _SetResult(v8::Handle<v8::Object> results, unsigned int index, v8::Handle<v8::Value> result) {
+    if(result.IsEmpty()) {
+      results->Set(index, v8::Undefined());
+    } else {
+      results->Set(index, result);
+    }
+  }
+
+  // Note: derived from 'value' as that changes when the value escapes its scope
+  inline v8::Handle<v8::Object> _object() const {
+    return v8::Handle<v8::Object>::Cast(value);
+  }
 };
 
 class JSArrayV8: public JSObjectV8, public virtual JSArray {
 
 public:
 
-  JSArrayV8(v8::Handle<v8::Array> arr): JSObjectV8(v8::Handle<v8::Object>::Cast(arr)), array(arr) {}
+  JSArrayV8(v8::Handle<v8::Array> arr, const JSContextDataV8Ptr& owner = JSContextDataV8Ptr()): JSObjectV8(v8::Handle<v8::Object>::Cast(arr), owner) {
+    type = Array;
+    typeKnown = true;
+  }
+
+  // For array-like objects with external elements (typed arrays).
+  JSArrayV8(v8::Handle<v8::Object> obj, const JSContextDataV8Ptr& owner = JSContextDataV8Ptr()): JSObjectV8(obj, owner) {
+    assert(obj->HasIndexedPropertiesInExternalArrayData());
+    type = Array;
+    typeKnown = true;
+  }
+
+  JSArrayV8(v8::Handle<v8::Value> val, JSBorrowed borrowed): JSObjectV8(val, borrowed) {
+    type = Array;
+    typeKnown = true;
+  }
 
   virtual ~JSArrayV8() {}
 
+  // Note: element access goes through '_object()' as it works
+  //   for arrays and typed arrays alike
+
   virtual JSValuePtr getAt(unsigned int index) {
-    return JSValuePtr(new JSValueV8(array->Get(index)));
+    return JSValuePtr(new JSValueV8(_object()->Get(index), owner));
   }
 
   virtual void setAt(unsigned int index, JSValuePtr val) {
-    array->Set(index, dynamic_cast<JSValueV8*>(JSOBJECTS_PTR_GET(val))->value);
+    _object()->Set(index, JSValueV8_cast(JSOBJECTS_PTR_GET(val))->value);
   };
 
   virtual void setAt(unsigned int index, const char *val) {
-    array->Set(index, v8::String::New(val));
+    _object()->Set(index, v8::String::New(val));
   }
 
   virtual void setAt(unsigned int index, const std::string& val) {
-    array->Set(index, v8::String::New(val.c_str()));
+    _object()->Set(index, JSValueV8_fromString(val));
+  }
+
+  virtual void setAt(unsigned int index, std::string&& val) {
+    setAt(index, static_cast<const std::string&>(val));
   }
 
   virtual void setAt(unsigned int index, bool val) {
-    array->Set(index, v8::Boolean::New(val));
+    _object()->Set(index, v8::Boolean::New(val));
   }
 
   virtual void setAt(unsigned int index, double val) {
-    array->Set(index, v8::Number::New(val));
+    _object()->Set(index, v8::Number::New(val));
   }
 
   virtual unsigned int length() {
-    return array->Length();
+    if(!value->IsArray()) {
+      return _object()->GetIndexedPropertiesExternalArrayDataLength();
+    }
+    return v8::Handle<v8::Array>::Cast(value)->Length();
   }
 
-protected:
-  v8::Handle<v8::Array> array;
+  virtual void readDoubles(unsigned int begin, unsigned int count, double* result) {
+    unsigned int len;
+    double* data = getFloat64Data(&len);
+    if(data != 0) {
+      assert(begin + count <= len);
+      memcpy(result, data + begin, count * sizeof(double));
+      return;
+    }
+
+    v8::HandleScope scope;
+    for(unsigned int idx = 0; idx < count; ++idx) {
+      result[idx] = _object()->Get(begin + idx)->NumberValue();
+    }
+  }
+
+  virtual void writeDoubles(unsigned int begin, unsigned int count, const double* values) {
+    unsigned int len;
+    double* data = getFloat64Data(&len);
+    if(data != 0) {
+      assert(begin + count <= len);
+      memcpy(data + begin, values, count * sizeof(double));
+      return;
+    }
+
+    v8::HandleScope scope;
+    for(unsigned int idx = 0; idx < count; ++idx) {
+      _object()->Set(begin + idx, v8::Number::New(values[idx]));
+    }
+  }
+};
+
+/**
+ * The state of a JSContextV8, shared with the values and native functions
+ * created through it.
+ *
+ * Values refer to this state instead of the wrapper, as they may outlive it,
+ * e.g., when a binding replaces the wrapper after the current context has changed.
+ */
+class JSContextDataV8 {
+
+public:
+
+  JSContextDataV8(v8::Handle<v8::Context> context): scope(0) {
+    this->context = v8::Persistent<v8::Context>::New(context);
+  }
+
+  ~JSContextDataV8() {
+    if(!functionTemplate.IsEmpty()) {
+      functionTemplate.Dispose();
+    }
+    if(!json.IsEmpty()) {
+      jsonStringify.Dispose();
+      jsonParse.Dispose();
+      json.Dispose();
+    }
+    context.Dispose();
+  }
+
+  // Looks up JSON.parse and JSON.stringify once per context.
+  void initJSON() {
+    if(!json.IsEmpty()) return;
+
+    v8::Handle<v8::Object> JSON = v8::Handle<v8::Object>::Cast(context->Global()->Get(v8::String::NewSymbol("JSON")));
+    json = v8::Persistent<v8::Object>::New(JSON);
+    jsonParse = v8::Persistent<v8::Function>::New(v8::Handle<v8::Function>::Cast(JSON->Get(v8::String::NewSymbol("parse"))));
+    jsonStringify = v8::Persistent<v8::Function>::New(v8::Handle<v8::Function>::Cast(JSON->Get(v8::String::NewSymbol("stringify"))));
+  }
+
+  v8::Persistent<v8::Context> context;
+
+  // the innermost open JSScopeV8, or 0
+  JSScopeV8* scope;
+
+  v8::Persistent<v8::Object> json;
+  v8::Persistent<v8::Function> jsonParse;
+  v8::Persistent<v8::Function> jsonStringify;
+
+  // the template of native function objects, created on first use
+  v8::Persistent<v8::FunctionTemplate> functionTemplate;
+
+private:
+
+  JSContextDataV8(const JSContextDataV8&);
+  JSContextDataV8& operator=(const JSContextDataV8&);
 };
 
 class JSContextV8: public JSContext {
 
 public:
 
-  JSContextV8() {}
+  // Binds to the current context.
+  JSContextV8(): data(new JSContextDataV8(v8::Context::GetCurrent())) {}
+
+  JSContextV8(v8::Handle<v8::Context> context): data(new JSContextDataV8(context)) {}
+
+  // Wraps the state of another wrapper, e.g., during a call of a native function.
+  JSContextV8(const JSContextDataV8Ptr& data): data(data) {}
 
   virtual ~JSContextV8() {}
 
+  v8::Handle<v8::Context> getContext() {
+    return data->context;
+  }
+
+  // the innermost open JSScopeV8, or 0
+  JSScopeV8* getScope() {
+    return data->scope;
+  }
+
+  const JSContextDataV8Ptr& getData() {
+    return data;
+  }
+
   virtual JSArrayPtr newArray(unsigned int length) {
     v8::Handle<v8::Array> arr = v8::Array::New(length);
-    return JSArrayPtr(new JSArrayV8(arr));
+    return JSArrayPtr(new JSArrayV8(arr, data));
   }
 
   virtual JSValuePtr newBoolean(bool val) {
-    return JSValuePtr(new JSValueV8(v8::Boolean::New(val)));
+    return JSValuePtr(new JSValueV8(v8::Boolean::New(val), data));
   }
 
   virtual JSValuePtr newNumber(double val) {
-    return JSValuePtr(new JSValueV8(v8::Number::New(val)));
+    return JSValuePtr(new JSValueV8(v8::Number::New(val), data));
   }
 
   virtual JSObjectPtr newObject() {
-    return JSObjectPtr(new JSObjectV8(v8::Object::New()));
+    return JSObjectPtr(new JSObjectV8(v8::Object::New(), data));
   }
 
   virtual JSValuePtr newString(const std::string& val) {
-    return JSValuePtr(new JSValueV8(JSValueV8_fromString(val)));
+    return JSValuePtr(new JSValueV8(JSValueV8_fromString(val), data));
   }
 
   virtual JSValuePtr newString(const char* val) {
-    return JSValuePtr(new JSValueV8(JSValueV8_fromString(val)));
+    return JSValuePtr(new JSValueV8(v8::String::New(val), data));
+  }
+
+  virtual JSValuePtr newString(std::string&& val) {
+    return newString(static_cast<const std::string&>(val));
+  }
+
+  // Creates a string which uses 'data' as content without copying.
+  // 'dispose' is called when V8 does not need the data anymore.
+  // Note: V8 supports this for ASCII content only; other strings are copied,
+  //   and 'dispose' is called right away.
+  JSValuePtr newExternalString(const char* data, size_t length,
+      JSExternalDisposeV8 dispose = 0, void* hint = 0) {
+    for(size_t idx = 0; idx < length; ++idx) {
+      if(static_cast<unsigned char>(data[idx]) >= 0x80) {
+        JSValuePtr result(new JSValueV8(v8::String::New(data, length), this->data));
+        if(dispose != 0) dispose(const_cast<char*>(data), hint);
+        return result;
+      }
+    }
+    return JSValuePtr(new JSValueV8(v8::String::NewExternal(
+      new JSExternalStringV8(data, length, dispose, hint)), this->data));
+  }
+
+  // Creates a Float64Array that uses 'data' as element storage without copying.
+  // 'dispose' is called when the array has been garbage collected;
+  // without it, the caller has to keep 'data' alive as long as the array is used.
+  JSArrayPtr newFloat64Array(double* data, unsigned int length,
+      JSExternalDisposeV8 dispose = 0, void* hint = 0) {
+    v8::Handle<v8::Object> obj = JSExternalArrayV8_New(data, v8::kExternalDoubleArray, length, dispose, hint);
+    return JSArrayPtr(new JSArrayV8(obj, this->data));
   }
 
   virtual JSValuePtr null() {
-    return JSValuePtr(new JSValueV8(v8::Null()));
+    return JSValuePtr(new JSValueV8(v8::Null(), data));
   }
 
   virtual JSValuePtr undefined() {
-    return JSValuePtr(new JSValueV8(v8::Undefined()));
+    return JSValuePtr(new JSValueV8(v8::Undefined(), data));
+  }
+
+  virtual JSPropertyKeyPtr newPropertyKey(const std::string& key) {
+    return JSPropertyKeyPtr(new JSPropertyKeyV8(key));
   }
 
+  // Note: the function refers to the state of this wrapper (see getData()) weakly,
+  //   i.e., it keeps neither the state nor the context alive, and it may be
+  //   called after the wrapper has been destroyed
+  inline virtual JSObjectPtr newFunction(JSNativeCallbackPtr callback);
+
   virtual JSValuePtr fromJson(const std::string& str) {
-    v8::HandleScope scope;
-    v8::Handle<v8::Object> JSON = v8::Local<v8::Object>::New(v8::Handle<v8::Object>::Cast(v8::Context::GetCurrent()->Global()->Get(v8::String::New("JSON"))));
-    v8::Handle<v8::Function> JSON_parse = v8::Handle<v8::Function>::Cast(JSON->Get(v8::String::New("parse")));
-    v8::Handle<v8::Value> val = v8::String::New(str.c_str());
-    return JSValuePtr(new JSValueV8(JSON_parse->Call(JSON, 1, &val)));
+    v8::HandleScope handleScope;
+    data->initJSON();
+    v8::Handle<v8::Value> val = JSValueV8_fromString(str);
+    v8::Handle<v8::Value> result = data->jsonParse->Call(data->json, 1, &val);
+    if(data->scope != 0) {
+      // Note: a scoped value needs a handle that outlives this handle scope
+      return JSValuePtr(new JSValueV8(handleScope.Close(result), data));
+    }
+    return JSValuePtr(new JSValueV8(result, data));
   }
 
   virtual std::string toJson(JSValuePtr val) {
-    v8::HandleScope scope;
-    v8::Handle<v8::Object> JSON = v8::Local<v8::Object>::New(v8::Handle<v8::Object>::Cast(v8::Context::GetCurrent()->Global()->Get(v8::String::New("JSON"))));
-    v8::Handle<v8::Function> JSON_stringify = v8::Handle<v8::Function>::Cast(JSON->Get(v8::String::New("stringify")));
-    JSValuePtr json(new JSValueV8(JSON_stringify->Call(JSON, 1, &(dynamic_cast<JSValueV8*>(JSOBJECTS_PTR_GET(val))->value))));
-    return json->asString();
+    v8::HandleScope handleScope;
+    data->initJSON();
+    v8::Handle<v8::Value> arg = JSValueV8_cast(JSOBJECTS_PTR_GET(val))->value;
+    // Note: the result is only read, i.e., no value wrapper needed
+    return JSValueV8_toString(data->jsonStringify->Call(data->json, 1, &arg));
   }
+
+protected:
+
+  friend class JSScopeV8;
+
+  JSContextDataV8Ptr data;
+
+private:
+
+  // Note: use the shared state (see getData()) to refer to this context
+  JSContextV8(const JSContextV8&);
+  JSContextV8& operator=(const JSContextV8&);
 };
 
+/**
+ * Lets values created in a native call frame use local handles.
+ *
+ * While a scope is open, values created through its JSContextV8 (and values
+ * derived from those, e.g. via get() or getAt()) do not allocate a persistent
+ * handle. Instead they hold a local handle of the HandleScope opened by this
+ * scope, which is released in one go when the scope is closed.
+ *
+ * Values that are still referenced when the scope is closed escape
+ * and get a persistent handle at that point. The slots of released values
+ * are reused; only when more values are alive at the same time than there
+ * are slots, new values are made persistent right away.
+ *
+ * Note: a local handle belongs to the innermost HandleScope at the time
+ *   the value is created. Scoped values must therefore not be created within
+ *   a nested v8::HandleScope that is closed before the value is released.
+ *
+ * Usage:
+ *
+ *     JSScopeV8 scope(context);
+ *     JSArrayPtr arr = context.fromJson(str)->asArray();
+ *     for(unsigned int idx = 0; idx < arr->length(); ++idx) { ... }
+ */
+class JSScopeV8 {
+
+public:
+
+  JSScopeV8(JSContextV8& context): context(context), previous(context.data->scope), used(0), freed(0) {
+    context.data->scope = this;
+  }
+
+  // Note: 'handleScope' is closed after the body, i.e., escaping values
+  //   can still be read here
+  ~JSScopeV8() {
+    for(size_t idx = 0; idx < used; ++idx) {
+      JSValueV8* val = values[idx];
+      if(val != 0) {
+        val->persistent = v8::Persistent<v8::Value>::New(val->value);
+        val->value = val->persistent;
+        val->scope = 0;
+      }
+    }
+    context.data->scope = previous;
+  }
+
+private:
+
+  friend class JSValueV8;
+
+  enum { SLOTS = 128 };
+
+  inline bool enter(JSValueV8* val) {
+    size_t slot;
+    if(freed > 0) {
+      slot = freeSlots[--freed];
+    } else if(used < SLOTS) {
+      slot = used++;
+    } else {
+      return false;
+    }
+    values[slot] = val;
+    val->scope = this;
+    val->scopeSlot = slot;
+    return true;
+  }
+
+  inline void leave(JSValueV8* val) {
+    values[val->scopeSlot] = 0;
+    freeSlots[freed++] = val->scopeSlot;
+  }
+
+  v8::HandleScope handleScope;
+
+  JSContextV8& context;
+  JSScopeV8* previous;
+
+  JSValueV8* values[SLOTS];
+  size_t used;
+
+  // the released slots below 'used', reused first
+  size_t freeSlots[SLOTS];
+  size_t freed;
+
+  // scopes must live on the stack
+  JSScopeV8(const JSScopeV8&);
+  JSScopeV8& operator=(const JSScopeV8&);
+  void* operator new(size_t);
+};
+
+void JSValueV8::_Retain(v8::Handle<v8::Value> val) {
+  JSScopeV8* current = owner ? owner->scope : 0;
+  if(current != 0 && current->enter(this)) {
+    value = v8::Local<v8::Value>::New(val);
+  } else {
+    persistent = v8::Persistent<v8::Value>::New(val);
+    value = persistent;
+  }
+}
+
+void JSValueV8::_Release() {
+  if(borrowed) return;
+  if(scope != 0) {
+    scope->leave(this);
+  } else {
+    persistent.Dispose();
+    persistent.Clear();
+  }
+}
+
+// The data of function objects created by JSContextV8::newFunction().
+struct JSFunctionDataV8 {
+  JSNativeCallbackPtr callback;
+  // Note: weak, as the state keeps the context, which in turn keeps
+  //   the functions installed on it
+  boost::weak_ptr<JSContextDataV8> owner;
+};
+
+inline void JSFunctionDataV8_WeakCallback(v8::Persistent<v8::Value> object, void* parameter) {
+  delete static_cast<JSFunctionDataV8*>(parameter);
+  object.Dispose();
+  object.Clear();
+}
+
+inline v8::Handle<v8::Value> JSFunctionV8_throw(const char* message) {
+  return v8::ThrowException(v8::Exception::Error(v8::String::New(message)));
+}
+
+inline v8::Handle<v8::Value> JSFunctionV8_callAsFunction(const v8::Arguments& args) {
+  v8::HandleScope handleScope;
+  JSFunctionDataV8* data = static_cast<JSFunctionDataV8*>(
+    v8::Handle<v8::External>::Cast(args.Holder()->GetInternalField(0))->Value());
+
+  JSValuePtr result;
+  // Note: C++ exceptions must not unwind through V8
+  try {
+    // the state of the creating wrapper, or a new one if no wrapper or value keeps it anymore
+    JSContextDataV8Ptr state = data->owner.lock();
+    if(!state) {
+      state.reset(new JSContextDataV8(v8::Context::GetCurrent()));
+      data->owner = state;
+    }
+    JSContextV8 owner(state);
+
+    // Note: the arguments live only during the call, i.e., local handles suffice
+    JSScopeV8 scope(owner);
+
+    enum { ARGS = 8 };
+    size_t argc = args.Length();
+    JSValuePtr fixed[ARGS];
+    std::vector<JSValuePtr> dynamic;
+    JSValuePtr* argv = fixed;
+    if(argc > ARGS) {
+      dynamic.resize(argc);
+      argv = &dynamic[0];
+    }
+    for(size_t idx = 0; idx < argc; ++idx) {
+      argv[idx].reset(new JSValueV8(args[idx], state));
+    }
+
+    result = data->callback->invoke(owner, argc, argv);
+  } catch(std::exception& e) {
+    return JSFunctionV8_throw(e.what());
+  } catch(const char* message) {
+    return JSFunctionV8_throw(message);
+  } catch(...) {
+    return JSFunctionV8_throw("Unknown native exception");
+  }
+
+  // a callback without a result returns undefined
+  if(!result) return v8::Undefined();
+  // Note: the result has escaped the scope above
+  return handleScope.Close(JSValueV8_cast(JSOBJECTS_PTR_GET(result))->value);
+}
+
+JSObjectPtr JSContextV8::newFunction(JSNativeCallbackPtr callback) {
+  if(this->data->functionTemplate.IsEmpty()) {
+    v8::HandleScope handleScope;
+    v8::Handle<v8::FunctionTemplate> tmpl = v8::FunctionTemplate::New();
+    tmpl->InstanceTemplate()->SetCallAsFunctionHandler(JSFunctionV8_callAsFunction);
+    tmpl->InstanceTemplate()->SetInternalFieldCount(1);
+    this->data->functionTemplate = v8::Persistent<v8::FunctionTemplate>::New(tmpl);
+  }
+
+  JSFunctionDataV8* data = new JSFunctionDataV8();
+  data->callback = callback;
+  data->owner = this->data;
+
+  v8::Handle<v8::Object> function = this->data->functionTemplate->InstanceTemplate()->NewInstance();
+  function->SetInternalField(0, v8::External::New(data));
+  v8::Persistent<v8::Value> weak = v8::Persistent<v8::Value>::New(function);
+  weak.MakeWeak(data, JSFunctionDataV8_WeakCallback);
+
+  return JSObjectPtr(new JSObjectV8(function, this->data));
+}
+
+// Conversion of std::vector to and from engine values, e.g., for bindings.
+// Numeric vectors become objects with external elements (V8's typed arrays)
+// which are filled with a single copy; other vectors become plain arrays.
+
+template <typename T>
+struct JSVectorTraitsV8;
+
+template <>
+struct JSVectorTraitsV8<double> {
+  static v8::Handle<v8::Value> toJS(double val) { return v8::Number::New(val); }
+  static double fromJS(v8::Handle<v8::Value> val) { return val->NumberValue(); }
+};
+
+template <>
+struct JSVectorTraitsV8<int> {
+  static v8::Handle<v8::Value> toJS(int val) { return v8::Integer::New(val); }
+  static int fromJS(v8::Handle<v8::Value> val) { return val->Int32Value(); }
+};
+
+template <>
+struct JSVectorTraitsV8<std::string> {
+  static v8::Handle<v8::Value> toJS(const std::string& val) { return JSValueV8_fromString(val); }
+  static std::string fromJS(v8::Handle<v8::Value> val) { return JSValueV8_toString(val); }
+};
+
+template <typename T>
+void JSVectorV8_free(void* data, void*) {
+  delete[] static_cast<T*>(data);
+}
+
+// Fallbacks for element types without external array support.
+template <typename T>
+inline bool JSVectorV8_toExternalArray(const std::vector<T>&, v8::Handle<v8::Value>&) {
+  return false;
+}
+
+template <typename T>
+inline bool JSVectorV8_fromExternalArray(v8::Handle<v8::Object>, std::vector<T>&) {
+  return false;
+}
+
+template <typename T>
+inline v8::Handle<v8::Value> JSVectorV8_makeExternalArray(v8::ExternalArrayType type, const std::vector<T>& vec) {
+  // Note: the copy is owned by the object, i.e., freed when it is collected
+  T* data = new T[vec.size()];
+  if(!vec.empty()) {
+    memcpy(data, &vec[0], vec.size() * sizeof(T));
+  }
+  return JSExternalArrayV8_New(data, type, vec.size(), JSVectorV8_free<T>, 0);
+}
+
+template <typename T>
+inline bool JSVectorV8_copyExternalArray(v8::ExternalArrayType type, v8::Handle<v8::Object> obj, std::vector<T>& result) {
+  if(!obj->HasIndexedPropertiesInExternalArrayData()
+      || obj->GetIndexedPropertiesExternalArrayDataType() != type) {
+    return false;
+  }
+  result.resize(obj->GetIndexedPropertiesExternalArrayDataLength());
+  if(!result.empty()) {
+    memcpy(&result[0], obj->GetIndexedPropertiesExternalArrayData(), result.size() * sizeof(T));
+  }
+  return true;
+}
+
+inline bool JSVectorV8_toExternalArray(const std::vector<double>& vec, v8::Handle<v8::Value>& result) {
+  result = JSVectorV8_makeExternalArray(v8::kExternalDoubleArray, vec);
+  return true;
+}
+
+inline bool JSVectorV8_toExternalArray(const std::vector<int>& vec, v8::Handle<v8::Value>& result) {
+  result = JSVectorV8_makeExternalArray(v8::kExternalIntArray, vec);
+  return true;
+}
+
+inline bool JSVectorV8_fromExternalArray(v8::Handle<v8::Object> obj, std::vector<double>& result) {
+  return JSVectorV8_copyExternalArray(v8::kExternalDoubleArray, obj, result);
+}
+
+inline bool JSVectorV8_fromExternalArray(v8::Handle<v8::Object> obj, std::vector<int>& result) {
+  return JSVectorV8_copyExternalArray(v8::kExternalIntArray, obj, result);
+}
+
+template <typename T>
+v8::Handle<v8::Value> JSVectorV8_toJS(const std::vector<T>& vec) {
+  v8::HandleScope scope;
+  v8::Handle<v8::Value> result;
+  if(!JSVectorV8_toExternalArray(vec, result)) {
+    v8::Handle<v8::Array> arr = v8::Array::New(vec.size());
+    for(size_t idx = 0; idx < vec.size(); ++idx) {
+      arr->Set(idx, JSVectorTraitsV8<T>::toJS(vec[idx]));
+    }
+    result = arr;
+  }
+  return scope.Close(result);
+}
+
+template <typename T>
+void JSVectorV8_fromJS(v8::Handle<v8::Value> val, std::vector<T>& result) {
+  v8::HandleScope scope;
+  v8::Handle<v8::Object> obj = v8::Handle<v8::Object>::Cast(val);
+  if(JSVectorV8_fromExternalArray(obj, result)) return;
+
+  result.resize(obj->Get(v8::String::NewSymbol("length"))->Uint32Value());
+  for(size_t idx = 0; idx < result.size(); ++idx) {
+    result[idx] = JSVectorTraitsV8<T>::fromJS(obj->Get(idx));
+  }
+}
+
 JSValuePtr CreateJSValueV8(v8::Handle<v8::Value> val) {
   return JSValuePtr(new JSValueV8(val));
 }
@@ -259,26 +1012,29 @@ JSArrayPtr CreateJSArrayV8(v8::Handle<v8::Array> arr) {
 
 JSArrayPtr JSValueV8::asArray() {
   assert(isArray());
-  return JSArrayPtr(new JSArrayV8(v8::Handle<v8::Array>::Cast(value)));
+  return JSArrayPtr(new JSArrayV8(v8::Handle<v8::Array>::Cast(value), owner));
 }
 
 JSObjectPtr JSValueV8::asObject() {
   assert(isObject());
-  return JSObjectPtr(new JSObjectV8(v8::Handle<v8::Object>::Cast(value)));
+  return JSObjectPtr(new JSObjectV8(v8::Handle<v8::Object>::Cast(value), owner));
 }
 
 JSObjectPtr JSValueV8::toObject(JSArrayPtr arr) {
-  return boost::dynamic_pointer_cast<JSObjectV8>(arr);
+  return arr;
 }
 
 JSValuePtr JSValueV8::toValue(JSArrayPtr arr) {
-  return boost::dynamic_pointer_cast<JSValueV8>(arr);
+  return arr;
 }
 
 JSValuePtr JSValueV8::toValue(JSObjectPtr obj) {
-  return boost::dynamic_pointer_cast<JSValueV8>(obj);
+  return obj;
 }
 
+// Direct (non-virtual) access to this backend, see jsobjects_static.hpp.
+typedef JSStatic<JSContextV8, JSValueV8, JSObjectV8, JSArrayV8> JSStaticV8;
+
 } // namespace jsobjects
 
 #endif // JSOBJECTS_V8_HPP
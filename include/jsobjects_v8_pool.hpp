@@ -0,0 +1,159 @@
+#ifndef JSOBJECTS_V8_POOL_HPP
+#define JSOBJECTS_V8_POOL_HPP
+
+#include "jsobjects_v8.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace jsobjects {
+
+/**
+ * Runs jobs on a fixed set of V8 isolates, each with its own context.
+ *
+ * A job is dispatched to a free isolate, i.e., up to 'size' jobs run in
+ * parallel and further callers block until an isolate becomes available.
+ * The job is called with the isolate locked and entered, within a
+ * HandleScope, and with the context entered:
+ *
+ *     JSContextPoolV8 pool(4);
+ *     // from any thread
+ *     pool.run(job);    // calls job(JSContextV8&)
+ *
+ * Note: values created within a job belong to the isolate of that job and
+ *   must not be used after the job has returned.
+ *
+ * Note: the JSContextV8 of the running job is published per thread
+ *   (see JSContextPoolV8::GetContext()), i.e., the isolates' data slots
+ *   are left to others.
+ */
+class JSContextPoolV8 {
+
+public:
+
+  JSContextPoolV8(size_t size): slots(size) {
+    for(size_t idx = 0; idx < size; ++idx) {
+      Slot& slot = slots[idx];
+      slot.isolate = v8::Isolate::New();
+      {
+        v8::Locker locker(slot.isolate);
+        v8::Isolate::Scope isolateScope(slot.isolate);
+        v8::HandleScope handleScope;
+        slot.context = v8::Context::New();
+        v8::Context::Scope contextScope(slot.context);
+        slot.jscontext.reset(new JSContextV8(slot.context));
+      }
+      available.push_back(idx);
+    }
+  }
+
+  // Note: all jobs must have finished
+  ~JSContextPoolV8() {
+    for(size_t idx = 0; idx < slots.size(); ++idx) {
+      Slot& slot = slots[idx];
+      {
+        v8::Locker locker(slot.isolate);
+        v8::Isolate::Scope isolateScope(slot.isolate);
+        slot.jscontext.reset();
+        slot.context.Dispose();
+        slot.context.Clear();
+      }
+      slot.isolate->Dispose();
+    }
+  }
+
+  size_t size() const {
+    return slots.size();
+  }
+
+  template <class Job>
+  void run(Job job) {
+    Lease lease(*this);
+    Slot& slot = slots[lease.index];
+    Current current(&slot.jscontext);
+
+    v8::Locker locker(slot.isolate);
+    v8::Isolate::Scope isolateScope(slot.isolate);
+    v8::HandleScope handleScope;
+    v8::Context::Scope contextScope(slot.context);
+    job(*slot.jscontext);
+  }
+
+  // The context of the job running on the current thread, 0 if there is none.
+  static boost::shared_ptr<JSContextV8> GetContext() {
+    boost::shared_ptr<JSContextV8>* current = _Current();
+    if(current == 0) return boost::shared_ptr<JSContextV8>();
+    return *current;
+  }
+
+private:
+
+  struct Slot {
+    v8::Isolate* isolate;
+    v8::Persistent<v8::Context> context;
+    boost::shared_ptr<JSContextV8> jscontext;
+  };
+
+  static boost::shared_ptr<JSContextV8>*& _Current() {
+    static thread_local boost::shared_ptr<JSContextV8>* current = 0;
+    return current;
+  }
+
+  // Publishes the context of a job for the lifetime of the job.
+  class Current {
+
+  public:
+
+    Current(boost::shared_ptr<JSContextV8>* jscontext): previous(_Current()) {
+      _Current() = jscontext;
+    }
+
+    ~Current() {
+      _Current() = previous;
+    }
+
+  private:
+
+    boost::shared_ptr<JSContextV8>* previous;
+  };
+
+  // Reserves a free slot for the lifetime of a job.
+  class Lease {
+
+  public:
+
+    Lease(JSContextPoolV8& pool): pool(pool) {
+      std::unique_lock<std::mutex> lock(pool.mutex);
+      while(pool.available.empty()) {
+        pool.released.wait(lock);
+      }
+      index = pool.available.back();
+      pool.available.pop_back();
+    }
+
+    ~Lease() {
+      {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.available.push_back(index);
+      }
+      pool.released.notify_one();
+    }
+
+    JSContextPoolV8& pool;
+    size_t index;
+  };
+
+  std::vector<Slot> slots;
+
+  std::mutex mutex;
+  std::condition_variable released;
+  std::vector<size_t> available;
+
+  JSContextPoolV8(const JSContextPoolV8&);
+  JSContextPoolV8& operator=(const JSContextPoolV8&);
+};
+
+} // namespace jsobjects
+
+#endif // JSOBJECTS_V8_POOL_HPP
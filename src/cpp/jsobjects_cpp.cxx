@@ -15,16 +15,14 @@ using rapidjson::GenericReader;
 
 namespace jsobjects {
   
-void JSValueCpp_toJSON(Writer< GenericStringBuffer< UTF8<char> > > &w, JSValuePtr val);
+void JSValueCpp_toJSON(Writer< GenericStringBuffer< UTF8<char> > > &w, JSValue& val);
 
 void JSValueCpp_toJSON_Object(Writer< GenericStringBuffer< UTF8<char> > > &w, JSObjectPtr obj) {
   w.StartObject();
-  const StrVector &keys = obj->getKeys();
-  for(StrVector::const_iterator it = keys.begin(); it != keys.end(); ++it) {
-    const std::string &key = *it;
-    w.String(key.c_str());
-    JSValueCpp_toJSON(w, obj->get(key));
-  }
+  obj->forEach([&w](const JSStringView& key, JSValue& val) {
+    w.String(key.c_str(), key.size());
+    JSValueCpp_toJSON(w, val);
+  });
   w.EndObject();
 }
 
@@ -33,32 +31,32 @@ void JSValueCpp_toJSON_Array(Writer< GenericStringBuffer< UTF8<char> > > &w, JSA
   w.StartArray();
   for(size_t idx = 0; idx < len; ++idx) {
     JSValuePtr val = array->getAt(idx);
-    JSValueCpp_toJSON(w, val);
+    JSValueCpp_toJSON(w, *val);
   }
   w.EndArray();
 }
 
-void JSValueCpp_toJSON(Writer< GenericStringBuffer< UTF8<char> > > &w, JSValuePtr val) {
-  switch(val->getType()) {
+void JSValueCpp_toJSON(Writer< GenericStringBuffer< UTF8<char> > > &w, JSValue& val) {
+  switch(val.getType()) {
     case JSValue::Null:
       w.Null();
       break;
     case JSValue::Undefined:
       break;
     case JSValue::Boolean:
-      w.Bool(val->asBool());
+      w.Bool(val.asBool());
       break;
     case JSValue::Number:
-      w.Double(val->asDouble());
+      w.Double(val.asDouble());
       break;
     case JSValue::String:
-      w.String(val->asString().c_str());
+      w.String(val.asString().c_str());
       break;
     case JSValue::Array:
-      JSValueCpp_toJSON_Array(w, val->asArray());
+      JSValueCpp_toJSON_Array(w, val.asArray());
       break;
     case JSValue::Object:
-      JSValueCpp_toJSON_Object(w, val->asObject());
+      JSValueCpp_toJSON_Object(w, val.asObject());
       break;
   }
 }
@@ -78,11 +76,17 @@ private:
 
 public:
 
-  JSObjectReaderHandler(JSContextCpp& context): context(context) {}
+  JSObjectReaderHandler(JSContextCpp& context, JSInternerCpp* interner = 0)
+    : context(context), interner(interner) {}
 
   void append(JSValuePtr val) {
     StackElem *tos = objStack.empty()? 0 : objStack.top();
 
+    // Note: values are complete when appended, i.e., children are interned first
+    if(interner != 0) {
+      val = interner->intern(val);
+    }
+
     if(tos == 0) {
       assert(JSOBJECTS_PTR_GET(root) == 0);
       root = val;
@@ -184,6 +188,7 @@ public:
 private:
 
   JSContextCpp& context;
+  JSInternerCpp* interner;
   JSValuePtr root;
 
   std::stack<StackElem*> objStack;
@@ -193,7 +198,7 @@ std::string JSContextCpp::toJson(JSValuePtr val)
 {
   GenericStringBuffer<UTF8<char> > strbuf;
   Writer< GenericStringBuffer< UTF8<char> > > w(strbuf);
-  JSValueCpp_toJSON(w, val);
+  JSValueCpp_toJSON(w, *val);
   return strbuf.GetString();
 }
 
@@ -261,4 +266,13 @@ JSValuePtr JSContextCpp::fromJson(const std::string& str) {
   return handler.GetResult();
 }
 
+JSValuePtr JSContextCpp::fromJson(const std::string& str, JSInternerCpp& interner) {
+  JSObjectReaderHandler handler(*this, &interner);
+  GenericReader<UTF8<char>, UTF8<char> > reader;
+  StringStream ss(str);
+  reader.Parse<0, StringStream, JSObjectReaderHandler>(ss, handler);
+
+  return handler.GetResult();
+}
+
 } // namespace jsobjects
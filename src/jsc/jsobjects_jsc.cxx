@@ -1 +1,2 @@
-#include <jsobjects_jsc.hpp>
\ No newline at end of file
+#include <jsobjects_jsc.hpp>
+#include <jsobjects_jsc_pool.hpp>
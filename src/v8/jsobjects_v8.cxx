@@ -1 +1,2 @@
 #include <jsobjects_v8.hpp>
+#include <jsobjects_v8_pool.hpp>
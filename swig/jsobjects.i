@@ -19,3 +19,35 @@ typedef boost::shared_ptr< JSContext > JSContextPtr;
 #else
 %include <jsobjects_jsc.i>
 #endif
+
+// std::vector arguments and results are converted as a whole:
+// numeric vectors to and from typed arrays (copying the elements at once),
+// others to and from plain arrays.
+%define JSOBJECTS_VECTOR_TYPEMAPS(T)
+
+%typemap(in) std::vector< T >
+%{
+  SWIGJS_ToVector($input, $1);
+%}
+
+%typemap(in) const std::vector< T >& (std::vector< T > temp)
+%{
+  SWIGJS_ToVector($input, temp);
+  $1 = &temp;
+%}
+
+%typemap(out) std::vector< T >
+%{
+  $result = SWIGJS_FromVector($1);
+%}
+
+%typemap(out) const std::vector< T >&
+%{
+  $result = SWIGJS_FromVector(*$1);
+%}
+
+%enddef
+
+JSOBJECTS_VECTOR_TYPEMAPS(double)
+JSOBJECTS_VECTOR_TYPEMAPS(int)
+JSOBJECTS_VECTOR_TYPEMAPS(std::string)
@@ -1,10 +1,35 @@
 %header %{
 #include <jsobjects_jsc.hpp>
+#include <jsobjects_jsc_pool.hpp>
+
+// used by the std::vector typemaps (see jsobjects.i)
+#define SWIGJS_FromVector(vec) jsobjects::JSVectorJSC_toJS(context, vec)
+#define SWIGJS_ToVector(input, vec) jsobjects::JSVectorJSC_fromJS(context, input, vec)
 %}
 
 %wrapper %{
 JSContextPtr SWIGJSC_theContext;
 
+// Note: a thread that leased a context from a JSContextPoolJSC
+//   uses the wrapper of that context when calling into it
+JSContextPtr SWIGJSC_GetContext(JSContextRef context) {
+  boost::shared_ptr<JSContextJSC> pooled = JSContextPoolJSC::GetContext();
+  if (pooled && pooled->getGlobalContext() == JSContextGetGlobalContext(context)) {
+    return pooled;
+  }
+  return SWIGJSC_theContext;
+}
+
+// The state of the wrapper of the calling context, e.g., to check for arrays
+//   with the cached constructor; empty if the context has not been wrapped
+JSContextDataJSCPtr SWIGJSC_GetContextData(JSContextRef context) {
+  boost::shared_ptr<JSContextJSC> wrapper = boost::static_pointer_cast<JSContextJSC>(SWIGJSC_GetContext(context));
+  if (wrapper && wrapper->getGlobalContext() == JSContextGetGlobalContext(context)) {
+    return wrapper->getData();
+  }
+  return JSContextDataJSCPtr();
+}
+
 extern "C" bool SWIGJSC_INIT (JSGlobalContextRef context);
 #define CONCAT(A,B) A##B
 #define JSOBJECTS(A) CONCAT(A,_jsobjects)
@@ -20,39 +45,60 @@ extern "C" bool JSOBJECTS(SWIGJSC_INIT) (JSGlobalContextRef context)
 
 namespace jsobjects {
 
-  %typemap(in) JSValuePtr
+  // Note: arguments are borrowed for the duration of the call, i.e., the
+  //   wrapper lives on the stack, the value is not protected, and the
+  //   pointer does not own the wrapper. The callee must not keep such an
+  //   argument (or a copy of the pointer) beyond the call. The wrapper
+  //   shares the state of the context wrapper (see SWIGJSC_GetContextData).
+  %typemap(in) JSValuePtr (JSStackValue<JSValueJSC> temp)
   %{
-    $1 = JSValuePtr(new JSValueJSC(context, $input));
+    $1 = JSValuePtr(JSValuePtr(), temp.init(context, $input, JSBorrowed(), SWIGJSC_GetContextData(context)));
   %}
 
   %typemap(out) JSValuePtr
   %{
-    $result = dynamic_cast<JSValueJSC*>(JSOBJECTS_PTR_GET($1))->value;
+    $result = JSValueJSC_cast(JSOBJECTS_PTR_GET($1))->value;
   %}
 
-  %typemap(in) JSObjectPtr
+  %typemap(in) JSObjectPtr (JSStackValue<JSObjectJSC> temp)
   %{
-    $1 = JSObjectPtr(new JSObjectJSC(context, $input));
+    $1 = JSObjectPtr(JSObjectPtr(), temp.init(context, $input, JSBorrowed(), SWIGJSC_GetContextData(context)));
   %}
 
   %typemap(out) JSObjectPtr
   %{
-    $result = dynamic_cast<JSObjectJSC*>(JSOBJECTS_PTR_GET($1))->value;
+    $result = JSValueJSC_cast(JSOBJECTS_PTR_GET($1))->value;
   %}
 
-  %typemap(in) JSArrayPtr
+  %typemap(in) JSArrayPtr (JSStackValue<JSArrayJSC> temp)
   %{
-    $1 = JSArrayPtr(new JSArrayJSC(context, $input));
+    $1 = JSArrayPtr(JSArrayPtr(), temp.init(context, $input, JSBorrowed(), SWIGJSC_GetContextData(context)));
   %}
 
   %typemap(out) JSArrayPtr
   %{
-    $result = dynamic_cast<JSArrayJSC*>(JSOBJECTS_PTR_GET($1))->value;
+    $result = JSValueJSC_cast(JSOBJECTS_PTR_GET($1))->value;
+  %}
+
+  // Note: reference arguments are borrowed the same way
+  %typemap(in) JSValue& (JSStackValue<JSValueJSC> temp)
+  %{
+    $1 = temp.init(context, $input, JSBorrowed(), SWIGJSC_GetContextData(context));
+  %}
+
+  %typemap(in) JSObject& (JSStackValue<JSObjectJSC> temp)
+  %{
+    $1 = temp.init(context, $input, JSBorrowed(), SWIGJSC_GetContextData(context));
+  %}
+
+  %typemap(in) JSArray& (JSStackValue<JSArrayJSC> temp)
+  %{
+    $1 = temp.init(context, $input, JSBorrowed(), SWIGJSC_GetContextData(context));
   %}
 
   %typemap(in) JSContextPtr, boost::shared< jsobjects::JSContext >
   %{
-    $1 = SWIGJSC_theContext;
+    $1 = SWIGJSC_GetContext(context);
   %}
 
   %typemap(check) JSContextPtr {}
@@ -1,38 +1,79 @@
 
 %header %{
 #include <jsobjects_v8.hpp>
+#include <jsobjects_v8_pool.hpp>
+
+// used by the std::vector typemaps (see jsobjects.i)
+#define SWIGJS_FromVector(vec) jsobjects::JSVectorV8_toJS(vec)
+#define SWIGJS_ToVector(input, vec) jsobjects::JSVectorV8_fromJS(input, vec)
+
+// Note: the context wrapper caches per-context state (e.g., the JSON functions)
+//   and is therefore reused as long as the current context does not change
+boost::shared_ptr<jsobjects::JSContextV8> SWIGV8_theContext;
+
+jsobjects::JSContextPtr SWIGV8_GetContext() {
+  // jobs of a JSContextPoolV8 come with the context wrapper of their isolate
+  boost::shared_ptr<jsobjects::JSContextV8> pooled = jsobjects::JSContextPoolV8::GetContext();
+  if (pooled) {
+    return pooled;
+  }
+  if (!SWIGV8_theContext || !(SWIGV8_theContext->getContext() == v8::Context::GetCurrent())) {
+    SWIGV8_theContext.reset(new jsobjects::JSContextV8());
+  }
+  return SWIGV8_theContext;
+}
 %}
 
 namespace jsobjects {
 
-%typemap(in) JSValuePtr
+// Note: arguments are borrowed for the duration of the call, i.e., the
+//   wrapper lives on the stack, uses the argument handle as is, and the
+//   pointer does not own the wrapper. The callee must not keep such an
+//   argument (or a copy of the pointer) beyond the call.
+%typemap(in) JSValuePtr (JSStackValue<JSValueV8> temp)
 %{
-  $1 = JSValuePtr(new JSValueV8($input));
+  $1 = JSValuePtr(JSValuePtr(), temp.init($input, JSBorrowed()));
 %}
 
 %typemap(out) JSValuePtr
 %{
-  $result = dynamic_cast<JSValueV8*>(JSOBJECTS_PTR_GET($1))->value;
+  $result = JSValueV8_cast(JSOBJECTS_PTR_GET($1))->value;
 %}
 
-%typemap(in) JSObjectPtr
+%typemap(in) JSObjectPtr (JSStackValue<JSObjectV8> temp)
 %{
-  $1 = JSObjectPtr(new JSObjectV8($input));
+  $1 = JSObjectPtr(JSObjectPtr(), temp.init($input, JSBorrowed()));
 %}
 
 %typemap(out) JSObjectPtr
 %{
-  $result = dynamic_cast<JSObjectV8*>(JSOBJECTS_PTR_GET($1))->value;
+  $result = JSValueV8_cast(JSOBJECTS_PTR_GET($1))->value;
 %}
 
-%typemap(in) JSArrayPtr
+%typemap(in) JSArrayPtr (JSStackValue<JSArrayV8> temp)
 %{
-  $1 = JSArrayPtr(new JSArrayV8($input));
+  $1 = JSArrayPtr(JSArrayPtr(), temp.init($input, JSBorrowed()));
 %}
 
 %typemap(out) JSArrayPtr
 %{
-  $result = dynamic_cast<JSArrayV8*>(JSOBJECTS_PTR_GET($1))->value;
+  $result = JSValueV8_cast(JSOBJECTS_PTR_GET($1))->value;
+%}
+
+// Note: reference arguments are borrowed the same way
+%typemap(in) JSValue& (JSStackValue<JSValueV8> temp)
+%{
+  $1 = temp.init($input, JSBorrowed());
+%}
+
+%typemap(in) JSObject& (JSStackValue<JSObjectV8> temp)
+%{
+  $1 = temp.init($input, JSBorrowed());
+%}
+
+%typemap(in) JSArray& (JSStackValue<JSArrayV8> temp)
+%{
+  $1 = temp.init($input, JSBorrowed());
 %}
 
 %typemap(newfree) JSValuePtr, JSObjectPtr, JSArrayPtr
@@ -42,7 +83,7 @@ namespace jsobjects {
 
 %typemap(in) JSContextPtr, boost::shared< jsobjects::JSContext >
 %{
-  $1 = JSContextPtr(new JSContextV8());
+  $1 = SWIGV8_GetContext();
 %}
 
 %typemap(check) JSContextPtr {}
@@ -0,0 +1,67 @@
+#include <jsobjects_cpp.hpp>
+#include <jsobjects_queue.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace jsobjects;
+
+// Measures the latency from posting a result on a worker thread until its
+// callback runs on the owning thread, for an increasing number of workers.
+
+typedef std::chrono::steady_clock Clock;
+
+static const int RESULTS_PER_WORKER = 100000;
+
+void run(int workers) {
+  JSContextCpp context;
+  JSCompletionQueue queue(context);
+
+  std::vector<double> latencies;
+  latencies.reserve(workers * RESULTS_PER_WORKER);
+  std::atomic<int> running(workers);
+
+  std::vector<std::thread> threads;
+  for(int w = 0; w < workers; ++w) {
+    threads.push_back(std::thread([&queue, &latencies, &running]() {
+      JSContextCpp local;
+      for(int i = 0; i < RESULTS_PER_WORKER; ++i) {
+        Clock::time_point posted = Clock::now();
+        queue.post(local.newNumber(i), [&latencies, posted](JSValuePtr) {
+          latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - posted).count());
+        });
+      }
+      --running;
+    }));
+  }
+
+  Clock::time_point start = Clock::now();
+  while(running > 0) {
+    queue.drain(256);
+  }
+  queue.drain();
+  double total = std::chrono::duration<double>(Clock::now() - start).count();
+
+  for(size_t idx = 0; idx < threads.size(); ++idx) {
+    threads[idx].join();
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  std::cout << "    " << workers << " worker(s): "
+    << latencies.size() / total << " results/s"
+    << ", median " << latencies[latencies.size() / 2] << " us"
+    << ", p99 " << latencies[latencies.size() * 99 / 100] << " us"
+    << ", max " << latencies.back() << " us" << std::endl;
+}
+
+int main() {
+  std::cout << "Completion queue latency (" << RESULTS_PER_WORKER << " results per worker):" << std::endl;
+  int cores = std::max(2u, std::thread::hardware_concurrency());
+  for(int workers = 1; workers <= 2 * cores; workers *= 2) {
+    run(workers);
+  }
+  return 0;
+}
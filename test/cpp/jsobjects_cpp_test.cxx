@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 #include <iostream>
 #include <jsobjects_cpp.hpp>
+#include <jsobjects_queue.hpp>
+#include <jsobjects_parallel.hpp>
+#include <thread>
 using namespace jsobjects;
 
 class JSObjectCppFixture: public testing::Test { 
@@ -45,6 +48,16 @@ TEST_F(JSObjectCppFixture, Create_String)
   EXPECT_STREQ("bla", jsstr->asString().c_str());
 }
 
+TEST_F(JSObjectCppFixture, Read_String_Into_Buffer)
+{
+  JSContextCpp context;
+  std::string buffer;
+  context.newString("bla")->asString(buffer);
+  EXPECT_STREQ("bla", buffer.c_str());
+  context.newString("foo")->asString(buffer);
+  EXPECT_STREQ("foo", buffer.c_str());
+}
+
 TEST_F(JSObjectCppFixture, Create_Simple_Object)
 {
   JSContextCpp context;
@@ -69,6 +82,20 @@ TEST_F(JSObjectCppFixture, Create_Nested_Object)
   EXPECT_EQ(JSValue::Object, obj->get("a")->getType());
 }
 
+TEST_F(JSObjectCppFixture, PropertyKey_Get_Set)
+{
+  JSContextCpp context;
+  JSPropertyKeyPtr key_a = context.newPropertyKey("a");
+  JSPropertyKeyPtr key_b = context.newPropertyKey("b");
+  JSObjectPtr obj = context.newObject();
+  obj->set(key_a, "bla");
+  obj->set(key_b, 2.0);
+
+  EXPECT_STREQ("a", key_a->getName().c_str());
+  EXPECT_STREQ("bla", obj->get("a")->asString().c_str());
+  EXPECT_EQ(2.0, obj->get(key_b)->asDouble());
+}
+
 TEST_F(JSObjectCppFixture, Create_Simple_Array)
 {
   JSContextCpp context;
@@ -80,6 +107,22 @@ TEST_F(JSObjectCppFixture, Create_Simple_Array)
   EXPECT_EQ(JSValue::Number, arr->getAt(1)->getType());
 }
 
+TEST_F(JSObjectCppFixture, Read_Write_Doubles)
+{
+  JSContextCpp context;
+  JSArrayPtr arr = context.newArray(4);
+  double values[] = { 1.0, 2.0, 3.0 };
+  arr->writeDoubles(1, 3, values);
+  arr->setAt(0, "bla");
+
+  double result[4];
+  arr->readDoubles(0, 4, result);
+  EXPECT_TRUE(result[0] != result[0]);
+  EXPECT_EQ(1.0, result[1]);
+  EXPECT_EQ(3.0, result[3]);
+  EXPECT_EQ(JSValue::Number, arr->getAt(2)->getType());
+}
+
 TEST_F(JSObjectCppFixture, Create_Nested_Array)
 {
   JSContextCpp context;
@@ -234,3 +277,468 @@ TEST_F(JSObjectCppFixture, Deserialize_Nested_Array)
   ASSERT_TRUE(val_1->isNumber());
   ASSERT_TRUE(val_2->isNumber());
 }
+
+static double add(double a, double b) {
+  return a + b;
+}
+
+TEST_F(JSObjectCppFixture, Native_Callback)
+{
+  JSContextCpp context;
+  JSValuePtr args[] = { context.newNumber(1.0), context.newNumber(2.0) };
+
+  JSNativeCallbackPtr f = CreateNativeCallback(&add);
+  EXPECT_EQ(3.0, f->invoke(context, 2, args)->asDouble());
+
+  std::string result;
+  JSNativeCallbackPtr g = CreateNativeCallback([&result](const std::string& s, int n) {
+    for(int i = 0; i < n; ++i) result += s;
+  });
+  JSValuePtr args2[] = { context.newString("ab"), context.newNumber(2.0) };
+  EXPECT_TRUE(g->invoke(context, 2, args2)->isUndefined());
+  EXPECT_STREQ("abab", result.c_str());
+
+  JSFunction<double, double, double>::Ptr h = CreateFunction<double, double, double>(add);
+  EXPECT_EQ(5.0, h->call(2.0, 3.0));
+}
+
+TEST_F(JSObjectCppFixture, Completion_Queue)
+{
+  JSContextCpp context;
+  JSCompletionQueue queue(context);
+
+  const int N = 1000;
+  std::vector<double> sums(4, 0.0);
+  std::vector<std::thread> workers;
+  for(size_t w = 0; w < sums.size(); ++w) {
+    workers.push_back(std::thread([&queue, &sums, w, N]() {
+      JSContextCpp local;
+      for(int i = 0; i < N; ++i) {
+        JSArrayPtr arr = local.newArray(1);
+        arr->setAt(0, (double) i);
+        queue.post(arr->toValue(arr), [&sums, w](JSValuePtr val) {
+          sums[w] += val->asArray()->getAt(0)->asDouble();
+        });
+      }
+    }));
+  }
+  for(size_t w = 0; w < workers.size(); ++w) {
+    workers[w].join();
+  }
+
+  EXPECT_EQ(10u, queue.drain(10));
+  queue.drain();
+  for(size_t w = 0; w < sums.size(); ++w) {
+    EXPECT_EQ(N * (N - 1) / 2.0, sums[w]);
+  }
+}
+
+static double square(double x, int) {
+  return x * x;
+}
+
+TEST_F(JSObjectCppFixture, Call_Each)
+{
+  JSContextCpp context;
+  JSObjectPtr f = context.newFunction(CreateNativeCallback(&square));
+
+  JSArrayPtr args = context.newArray(3);
+  double values[] = { 1.0, 2.0, 3.0 };
+  args->writeDoubles(0, 3, values);
+  JSArrayPtr results = context.newArray(3);
+  f->callEach(args, results);
+  EXPECT_EQ(9.0, results->getAt(2)->asDouble());
+
+  std::vector<JSValuePtr> callArgs(2);
+  callArgs[0] = context.newNumber(4.0);
+  callArgs[1] = context.newNumber(0.0);
+  EXPECT_EQ(16.0, f->call(callArgs)->asDouble());
+}
+
+template <class B>
+static double sumStatic(JSArray& arr) {
+  typename B::Array& a = B::array(arr);
+  double result = 0;
+  for(unsigned int idx = 0; idx < B::length(a); ++idx) {
+    result += B::asDouble(B::value(B::getAt(a, idx)));
+  }
+  return result;
+}
+
+TEST_F(JSObjectCppFixture, Static_Access)
+{
+  JSContextCpp context;
+  JSArrayPtr arr = context.newArray(3);
+  JSStaticCpp::Array& a = JSStaticCpp::array(arr);
+  for(unsigned int idx = 0; idx < 3; ++idx) {
+    JSStaticCpp::setAt(a, idx, idx + 1.0);
+  }
+  EXPECT_EQ(6.0, sumStatic<JSStaticCpp>(*arr));
+
+  JSObjectPtr obj = JSStaticCpp::newObject(context);
+  JSStaticCpp::set(JSStaticCpp::object(obj), "a", arr->toValue(arr));
+  JSValuePtr val = JSStaticCpp::get(JSStaticCpp::object(obj), "a");
+  EXPECT_EQ(JSValue::Array, JSStaticCpp::getType(JSStaticCpp::value(val)));
+  EXPECT_EQ(3u, JSStaticCpp::length(JSStaticCpp::array(val->asArray())));
+}
+
+TEST_F(JSObjectCppFixture, String_Keys_And_Moves)
+{
+  JSContextCpp context;
+  JSObjectPtr obj = context.newObject();
+  std::string key("name");
+  obj->set("literal", 1.0);
+  obj->set(key, std::string("moved"));
+  obj->set(JSStringView("view", 4), "value");
+  EXPECT_EQ(1.0, obj->get("literal")->asDouble());
+  EXPECT_EQ("moved", obj->get(key)->asString());
+  EXPECT_EQ("value", obj->get(std::string("view"))->asString());
+  obj->set(JSStringView("copy", 4), obj->get(JSStringView("view", 4)));
+  EXPECT_EQ("value", obj->get("copy")->asString());
+  EXPECT_FALSE(obj->get("view")->isUndefined());
+
+  JSArrayPtr arr = context.newArray(1);
+  std::string str(100, 'x');
+  arr->setAt(0, std::move(str));
+  EXPECT_EQ(100u, arr->getAt(0)->asString().size());
+  EXPECT_EQ("abc", context.newString(std::string("abc"))->asString());
+}
+
+TEST_F(JSObjectCppFixture, For_Each_Property)
+{
+  JSContextCpp context;
+  JSObjectPtr obj = context.newObject();
+  obj->set("a", 1.0);
+  obj->set("b", 2.0);
+  obj->set("c", "three");
+
+  std::string keys;
+  double sum = 0;
+  obj->forEach([&keys, &sum](const JSStringView& key, JSValue& value) {
+    keys += key.c_str();
+    if(value.getType() == JSValue::Number) sum += value.asDouble();
+  });
+  EXPECT_EQ("abc", keys);
+  EXPECT_EQ(3.0, sum);
+}
+
+TEST_F(JSObjectCppFixture, Deep_Equals_And_Hash)
+{
+  JSContextCpp context;
+  std::string json("{\"a\":[1,2,{\"b\":\"c\"}],\"d\":true}");
+  JSValuePtr a = context.fromJson(json);
+  JSValuePtr b = context.fromJson(json);
+  JSValueCpp& cppA = JSStaticCpp::value(a);
+  JSValueCpp& cppB = JSStaticCpp::value(b);
+
+  EXPECT_TRUE(JSDeepEquals(a, b));
+  EXPECT_TRUE(cppA.deepEquals(cppB));
+  EXPECT_EQ(JSHash(a), JSHash(b));
+  EXPECT_EQ(JSHash(a), cppA.hash());
+  EXPECT_EQ(cppA.hash(), cppA.hash(true));
+  EXPECT_EQ(cppB.hash(), cppB.hash(true));
+
+  // the hashes of mutable nodes are not memoized, i.e., they follow modifications
+  b->asObject()->get("a")->asArray()->getAt(2)->asObject()->set("b", "x");
+  EXPECT_FALSE(JSDeepEquals(a, b));
+  EXPECT_FALSE(cppA.deepEquals(cppB));
+  EXPECT_NE(cppA.hash(true), cppB.hash(true));
+  EXPECT_EQ(JSHash(b), cppB.hash(true));
+
+  EXPECT_TRUE(JSDeepEquals(context.newNumber(0.0 / 0.0), context.newNumber(0.0 / 0.0)));
+  EXPECT_FALSE(JSDeepEquals(context.newNumber(1.0), context.newString("1")));
+}
+
+TEST_F(JSObjectCppFixture, Hash_After_Outside_Modification)
+{
+  JSContextCpp context;
+  JSObjectPtr pa = context.newObject();
+  JSObjectPtr pb = context.newObject();
+  JSObjectPtr ca = context.newObject();
+  JSObjectPtr cb = context.newObject();
+  ca->set("x", 2.0);
+  cb->set("x", 1.0);
+  pa->set("c", ca);
+  pb->set("c", cb);
+  JSValueCpp& cppA = JSStaticCpp::value(pa);
+  JSValueCpp& cppB = JSStaticCpp::value(pb);
+  EXPECT_NE(cppA.hash(true), cppB.hash(true));
+
+  // modified through a reference obtained before hashing
+  ca->set("x", 1.0);
+  EXPECT_TRUE(cppA.deepEquals(cppB));
+  EXPECT_EQ(JSHash(pa), cppA.hash(true));
+  EXPECT_EQ(cppA.hash(true), cppB.hash(true));
+
+  // frozen subtrees reuse their memoized hashes
+  cppA.freeze();
+  pb->set("y", 1.0);
+  cppB.freeze();
+  EXPECT_FALSE(cppA.deepEquals(cppB));
+  EXPECT_EQ(JSHash(pb), cppB.hash(true));
+}
+
+TEST_F(JSObjectCppFixture, Intern_Values)
+{
+  JSContextCpp context;
+  JSInternerCpp interner;
+  std::string json("[{\"a\":\"x\",\"b\":[1,2]},{\"a\":\"x\",\"b\":[1,2]},\"x\"]");
+  JSValuePtr root = context.fromJson(json, interner);
+  JSArrayPtr arr = root->asArray();
+
+  EXPECT_TRUE(arr->getAt(0) == arr->getAt(1));
+  EXPECT_TRUE(arr->getAt(0)->asObject()->get("a") == arr->getAt(2));
+  // "x", 1, 2, [1,2], the object and the array itself
+  EXPECT_EQ(6u, interner.size());
+  EXPECT_TRUE(JSStaticCpp::value(arr->getAt(0)).isFrozen());
+  EXPECT_THROW(arr->getAt(0)->asObject()->set("a", "y"), JSValueErrorCpp);
+
+  // interning a separately parsed copy yields the shared value
+  JSValuePtr copy = interner.intern(context.fromJson(json));
+  EXPECT_TRUE(copy == root);
+  EXPECT_EQ(6u, interner.size());
+}
+
+TEST_F(JSObjectCppFixture, Clone_Copy_On_Write)
+{
+  JSContextCpp context;
+  JSValuePtr tmpl = context.fromJson("{\"a\":{\"b\":{\"c\":1}},\"d\":[1,2]}");
+  JSValuePtr copy = JSStaticCpp::value(tmpl).clone();
+  EXPECT_TRUE(JSDeepEquals(tmpl, copy));
+
+  copy->asObject()->get("a")->asObject()->get("b")->asObject()->set("c", 2.0);
+  copy->asObject()->get("d")->asArray()->setAt(0, "x");
+  EXPECT_EQ(1.0, tmpl->asObject()->get("a")->asObject()->get("b")->asObject()->get("c")->asDouble());
+  EXPECT_EQ(1.0, tmpl->asObject()->get("d")->asArray()->getAt(0)->asDouble());
+  EXPECT_EQ(2.0, copy->asObject()->get("a")->asObject()->get("b")->asObject()->get("c")->asDouble());
+
+  // the template can still be modified, independently of the clone
+  tmpl->asObject()->get("d")->asArray()->setAt(1, 3.0);
+  EXPECT_EQ(2.0, copy->asObject()->get("d")->asArray()->getAt(1)->asDouble());
+
+  // clones of frozen values can be modified
+  JSInternerCpp interner;
+  JSValuePtr frozen = context.fromJson("{\"a\":{\"b\":1}}", interner);
+  JSValuePtr custom = JSStaticCpp::value(frozen).clone();
+  custom->asObject()->get("a")->asObject()->set("b", 2.0);
+  EXPECT_EQ(1.0, frozen->asObject()->get("a")->asObject()->get("b")->asDouble());
+  EXPECT_EQ(2.0, custom->asObject()->get("a")->asObject()->get("b")->asDouble());
+}
+
+TEST_F(JSObjectCppFixture, Clone_Keeps_References)
+{
+  JSContextCpp context;
+  JSValuePtr tmpl = context.fromJson("{\"a\":{\"b\":{\"c\":1}},\"d\":[[1],2]}");
+  JSObjectPtr a = tmpl->asObject()->get("a")->asObject();
+  JSObjectPtr b = a->get("b")->asObject();
+  JSArrayPtr d0 = tmpl->asObject()->get("d")->asArray()->getAt(0)->asArray();
+  JSValuePtr copy = JSStaticCpp::value(tmpl).clone();
+
+  // references obtained before cloning modify the template only
+  b->set("c", 2.0);
+  a->set("e", true);
+  d0->setAt(0, 3.0);
+  EXPECT_EQ(2.0, tmpl->asObject()->get("a")->asObject()->get("b")->asObject()->get("c")->asDouble());
+  EXPECT_EQ(1.0, copy->asObject()->get("a")->asObject()->get("b")->asObject()->get("c")->asDouble());
+  EXPECT_FALSE(copy->asObject()->get("a")->asObject()->get("e"));
+  EXPECT_EQ(1.0, copy->asObject()->get("d")->asArray()->getAt(0)->asArray()->getAt(0)->asDouble());
+
+  // references into the clone see each other's modifications
+  JSObjectPtr cb = copy->asObject()->get("a")->asObject()->get("b")->asObject();
+  JSObjectPtr cb2 = copy->asObject()->get("a")->asObject()->get("b")->asObject();
+  cb->set("c", 4.0);
+  EXPECT_EQ(4.0, cb2->get("c")->asDouble());
+  EXPECT_EQ(4.0, copy->asObject()->get("a")->asObject()->get("b")->asObject()->get("c")->asDouble());
+  EXPECT_EQ(2.0, b->get("c")->asDouble());
+
+  b->set("c", 5.0);
+  EXPECT_EQ(4.0, cb->get("c")->asDouble());
+  EXPECT_EQ(5.0, tmpl->asObject()->get("a")->asObject()->get("b")->asObject()->get("c")->asDouble());
+
+  // clones of clones
+  JSValuePtr second = JSStaticCpp::value(copy).clone();
+  cb->set("c", 6.0);
+  EXPECT_EQ(4.0, second->asObject()->get("a")->asObject()->get("b")->asObject()->get("c")->asDouble());
+  EXPECT_EQ(6.0, cb2->get("c")->asDouble());
+}
+
+TEST_F(JSObjectCppFixture, Clone_Destroyed_Before_Source)
+{
+  JSContextCpp context;
+  JSThreadPool pool(2);
+  JSValuePtr tmpl = context.fromJson("{\"a\":{\"b\":{\"c\":1}},\"l\":[{\"x\":1},{\"x\":2}]}");
+  JSObjectPtr b = tmpl->asObject()->get("a")->asObject()->get("b")->asObject();
+  JSObjectPtr l1 = tmpl->asObject()->get("l")->asArray()->getAt(1)->asObject();
+  {
+    // clones, copies made by modifying them, and arrays sharing their elements
+    JSValuePtr copy = JSStaticCpp::value(tmpl).clone();
+    JSValuePtr second = JSStaticCpp::value(copy).clone();
+    copy->asObject()->get("a")->asObject()->get("b")->asObject()->set("c", 2.0);
+    b->set("c", 3.0);
+    JSArrayPtr picked = JSParallelCpp::filter(pool, *second->asObject()->get("l")->asArray(),
+      [](JSValue& val, unsigned int) { return val.asObject()->get("x")->asDouble() > 1.0; });
+    EXPECT_EQ(1u, picked->length());
+  }
+  // the source must not refer to the destroyed clones anymore
+  b->set("c", 4.0);
+  l1->set("x", 5.0);
+  tmpl->asObject()->set("a", 0.0);
+  EXPECT_EQ(4.0, b->get("c")->asDouble());
+  EXPECT_EQ(5.0, tmpl->asObject()->get("l")->asArray()->getAt(1)->asObject()->get("x")->asDouble());
+}
+
+TEST_F(JSObjectCppFixture, Empty_Elements)
+{
+  JSContextCpp context;
+  JSObjectPtr obj = context.newObject();
+  obj->set("k", JSValuePtr());
+  std::vector<JSValuePtr> elements(2);
+  elements[1] = obj;
+  JSArrayPtr arr = context.newArray(elements);
+
+  JSValuePtr copy = JSStaticCpp::value(arr).clone();
+  EXPECT_TRUE(JSStaticCpp::value(arr).deepEquals(JSStaticCpp::value(copy)));
+  EXPECT_EQ(JSStaticCpp::value(arr).hash(), JSStaticCpp::value(copy).hash());
+  copy->asArray()->getAt(1)->asObject()->set("k", 1.0);
+  EXPECT_FALSE(obj->get("k"));
+  arr->setAt(0, 1.0);
+
+  JSStaticCpp::value(arr).freeze();
+  EXPECT_THROW(arr->setAt(0, 2.0), JSValueErrorCpp);
+}
+
+TEST_F(JSObjectCppFixture, Freeze_Concurrent_Read)
+{
+  JSContextCpp context;
+  JSValuePtr doc = context.fromJson("{\"name\":\"config\",\"limits\":[1,2,3],\"server\":{\"port\":8080,\"tls\":true}}");
+  JSStaticCpp::value(doc).freeze();
+  EXPECT_TRUE(JSStaticCpp::value(doc).isFrozen());
+  EXPECT_TRUE(JSStaticCpp::value(doc->asObject()->get("server")).isFrozen());
+
+  std::vector<std::thread> threads;
+  std::vector<int> errors(4, 0);
+  for(size_t t = 0; t < errors.size(); ++t) {
+    threads.push_back(std::thread([&doc, &errors, t]() {
+      JSFrozenValueCpp root(doc);
+      for(int i = 0; i < 1000; ++i) {
+        if(root.get("name").asString() != "config") ++errors[t];
+        if(root.get("limits").length() != 3 || root.get("limits").getAt(2).asDouble() != 3.0) ++errors[t];
+        if(root.get("server").get("port").asDouble() != 8080.0) ++errors[t];
+        if(!root.get("server").get("tls").asBool()) ++errors[t];
+        if(!root.get("missing").isUndefined()) ++errors[t];
+      }
+    }));
+  }
+  for(size_t t = 0; t < threads.size(); ++t) {
+    threads[t].join();
+    EXPECT_EQ(0, errors[t]);
+  }
+
+  StrVector keys;
+  JSFrozenValueCpp(doc).forEach([&keys](const JSStringView& key, JSFrozenValueCpp) {
+    keys.push_back(key.str());
+  });
+  ASSERT_EQ(3, keys.size());
+  EXPECT_EQ("limits", keys[0]);
+
+  // reading missing properties does not add them
+  EXPECT_FALSE(doc->asObject()->get("missing"));
+  EXPECT_EQ(3, doc->asObject()->getKeys().size());
+
+  EXPECT_ANY_THROW(doc->asObject()->set("name", "other"));
+  EXPECT_ANY_THROW(doc->asObject()->get("limits")->asArray()->setAt(0, 0.0));
+}
+
+TEST_F(JSObjectCppFixture, Parallel_Algorithms)
+{
+  JSContextCpp context;
+  JSThreadPool pool(4);
+  const unsigned int length = 10000;
+  JSArrayPtr arr = context.newArray(length);
+  for(unsigned int idx = 0; idx < length; ++idx) {
+    JSObjectPtr rec = context.newObject();
+    rec->set("key", static_cast<double>(idx % 10));
+    rec->set("idx", static_cast<double>(idx));
+    arr->setAt(idx, rec->toValue(rec));
+  }
+
+  std::atomic<unsigned int> visited(0);
+  JSParallelCpp::forEach(pool, *arr, [&visited](JSValue&, unsigned int) { ++visited; });
+  EXPECT_EQ(length, visited.load());
+
+  JSArrayPtr keys = JSParallelCpp::map(pool, *arr, [](JSValue& rec, unsigned int) {
+    return rec.asObject()->get("key");
+  });
+  ASSERT_EQ(length, keys->length());
+  EXPECT_EQ(3.0, keys->getAt(13)->asDouble());
+
+  JSArrayPtr zeros = JSParallelCpp::filter(pool, *keys, [](JSValue& key, unsigned int) {
+    return key.asDouble() == 0;
+  });
+  EXPECT_EQ(length / 10, zeros->length());
+
+  double sum = JSParallelCpp::reduce(pool, *keys, 0.0,
+    [](double acc, JSValue& key, unsigned int) { return acc + key.asDouble(); },
+    [](double a, double b) { return a + b; });
+  EXPECT_EQ(45.0 * length / 10, sum);
+
+  // stable, i.e., equal keys stay in the order of their indexes
+  JSParallelCpp::sort(pool, *arr, [](JSValue& a, JSValue& b) {
+    return a.asObject()->get("key")->asDouble() > b.asObject()->get("key")->asDouble();
+  }, 100);
+  double lastKey = 9, lastIdx = -1;
+  int errors = 0;
+  for(unsigned int idx = 0; idx < length; ++idx) {
+    JSObjectPtr rec = arr->getAt(idx)->asObject();
+    double key = rec->get("key")->asDouble();
+    double recIdx = rec->get("idx")->asDouble();
+    if(key > lastKey || (key == lastKey && recIdx <= lastIdx)) ++errors;
+    lastKey = key;
+    lastIdx = recIdx;
+  }
+  EXPECT_EQ(0, errors);
+
+  // nested calls and exceptions
+  std::atomic<unsigned int> inner(0);
+  JSParallelFor(pool, 16, [&pool, &inner](unsigned int, unsigned int) {
+    JSParallelFor(pool, 1000, [&inner](unsigned int begin, unsigned int end) { inner += end - begin; }, 10);
+  }, 1);
+  EXPECT_EQ(16000, inner.load());
+  EXPECT_ANY_THROW(JSParallelCpp::forEach(pool, *arr, [](JSValue&, unsigned int idx) {
+    if(idx == 5000) throw "Failed";
+  }));
+}
+
+TEST_F(JSObjectCppFixture, Parallel_Empty_Elements)
+{
+  JSContextCpp context;
+  JSThreadPool pool(4);
+  std::vector<JSValuePtr> elements(1000);
+  for(size_t idx = 0; idx < elements.size(); idx += 2) {
+    elements[idx] = context.newNumber(static_cast<double>(idx));
+  }
+  JSArrayPtr arr = context.newArray(elements);
+
+  std::atomic<unsigned int> visited(0);
+  JSParallelCpp::forEach(pool, *arr, [&visited](JSValue&, unsigned int) { ++visited; }, 10);
+  EXPECT_EQ(500u, visited.load());
+
+  JSArrayPtr copies = JSParallelCpp::map(pool, *arr, [](JSValue& val, unsigned int) {
+    return JSValuePtr(new JSValueCpp(val.asDouble()));
+  }, 10);
+  EXPECT_EQ(2.0, copies->getAt(2)->asDouble());
+  EXPECT_FALSE(copies->getAt(3));
+
+  JSArrayPtr all = JSParallelCpp::filter(pool, *arr, [](JSValue&, unsigned int) { return true; }, 10);
+  EXPECT_EQ(500u, all->length());
+
+  double sum = JSParallelCpp::reduce(pool, *arr, 0.0,
+    [](double acc, JSValue& val, unsigned int) { return acc + val.asDouble(); },
+    [](double a, double b) { return a + b; }, 10);
+  EXPECT_EQ(249500.0, sum);
+
+  JSParallelCpp::sort(pool, *arr, [](JSValue& a, JSValue& b) { return a.asDouble() > b.asDouble(); }, 10);
+  EXPECT_EQ(998.0, arr->getAt(0)->asDouble());
+  EXPECT_EQ(0.0, arr->getAt(499)->asDouble());
+  EXPECT_FALSE(arr->getAt(500));
+}
@@ -0,0 +1,62 @@
+#include <JavaScriptCore/JavaScript.h>
+#include <jsobjects_jsc.hpp>
+#include <iostream>
+#include <ctime>
+
+using namespace jsobjects;
+
+// Measures the cost of wrapping an engine value into a JSValueJSC,
+// with and without asking for its type afterwards.
+
+static const int ITERATIONS = 1000000;
+
+double wrap(JSContextJSC& jscontext, JSContextRef context, JSValueRef val, bool classify) {
+	clock_t start = clock();
+	for(int idx = 0; idx < ITERATIONS; ++idx) {
+		JSValuePtr wrapped(new JSValueJSC(context, val, jscontext.getData()));
+		if(classify) wrapped->getType();
+	}
+	clock_t end = clock();
+	return (end - start) * 1.0e9 / CLOCKS_PER_SEC / ITERATIONS;
+}
+
+void run(JSContextJSC& jscontext, JSContextRef context, const char* name, JSValueRef val) {
+	JSValueProtect(context, val);
+
+	double passthrough = wrap(jscontext, context, val, false);
+	double classified = wrap(jscontext, context, val, true);
+	double scoped;
+	{
+		JSScopeJSC scope(jscontext);
+		scoped = wrap(jscontext, context, val, true);
+	}
+
+	std::cout << "    " << name
+		<< ": wrap " << passthrough << " ns"
+		<< ", wrap+getType " << classified << " ns"
+		<< ", scoped wrap+getType " << scoped << " ns" << std::endl;
+
+	JSValueUnprotect(context, val);
+}
+
+int main() {
+
+	JSGlobalContextRef context = JSGlobalContextCreate(NULL);
+	JSContextJSC jscontext(context);
+
+	JSStringRef str = JSStringCreateWithUTF8CString("bla");
+
+	std::cout << "Wrap cost per value (" << ITERATIONS << " iterations):" << std::endl;
+	run(jscontext, context, "undefined", JSValueMakeUndefined(context));
+	run(jscontext, context, "null     ", JSValueMakeNull(context));
+	run(jscontext, context, "boolean  ", JSValueMakeBoolean(context, true));
+	run(jscontext, context, "number   ", JSValueMakeNumber(context, 1.0));
+	run(jscontext, context, "string   ", JSValueMakeString(context, str));
+	run(jscontext, context, "object   ", JSObjectMake(context, 0, 0));
+	run(jscontext, context, "array    ", JSObjectMakeArray(context, 0, 0, 0));
+
+	JSStringRelease(str);
+	JSGlobalContextRelease(context);
+
+	return 0;
+}
@@ -0,0 +1,211 @@
+#include <JavaScriptCore/JavaScript.h>
+#include <jsobjects_jsc.hpp>
+#include <iostream>
+#include <stdexcept>
+
+using namespace jsobjects;
+
+static JSValueRef evaluate(JSContextRef ctx, const char* script, JSValueRef* exception) {
+	JSStringRef jsscript = JSStringCreateWithUTF8CString(script);
+	JSValueRef result = JSEvaluateScript(ctx, jsscript, 0, 0, 0, exception);
+	JSStringRelease(jsscript);
+	return result;
+}
+
+static double add(double a, double b) {
+	return a + b;
+}
+
+static void fail() {
+	throw std::runtime_error("native error");
+}
+
+static void fail_unknown() {
+	throw 42;
+}
+
+// returns no value at all
+class EmptyCallback: public JSNativeCallback {
+public:
+	virtual JSValuePtr invoke(JSContext&, size_t, const JSValuePtr*) {
+		return JSValuePtr();
+	}
+};
+
+// records its destruction
+class TrackedCallback: public EmptyCallback {
+public:
+	TrackedCallback(bool* destroyed): destroyed(destroyed) {}
+	~TrackedCallback() {
+		*destroyed = true;
+	}
+private:
+	bool* destroyed;
+};
+
+bool call_from_script(JSContextRef ctx, JSContextJSC& context) {
+	std::cout << "    -- Test:  call_from_script... ";
+	{
+		JSObjectPtr global(new JSObjectJSC(ctx, JSContextGetGlobalObject(ctx)));
+		global->set("add", context.newFunction(CreateNativeCallback(&add)));
+
+		JSValueRef result = evaluate(ctx, "add(1, 2)", 0);
+		if (!JSValueIsNumber(ctx, result)) goto fail;
+		if (JSValueToNumber(ctx, result, 0) != 3.0) goto fail;
+	}
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+bool exception_from_native(JSContextRef ctx, JSContextJSC& context) {
+	std::cout << "    -- Test:  exception_from_native... ";
+	{
+		JSObjectPtr global(new JSObjectJSC(ctx, JSContextGetGlobalObject(ctx)));
+		global->set("fail", context.newFunction(CreateNativeCallback(&fail)));
+
+		JSValueRef exception = 0;
+		evaluate(ctx, "fail()", &exception);
+		if (exception == 0) goto fail;
+	}
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+bool unknown_exception_from_native(JSContextRef ctx, JSContextJSC& context) {
+	std::cout << "    -- Test:  unknown_exception_from_native... ";
+	{
+		JSObjectPtr global(new JSObjectJSC(ctx, JSContextGetGlobalObject(ctx)));
+		global->set("fail_unknown", context.newFunction(CreateNativeCallback(&fail_unknown)));
+
+		JSValueRef exception = 0;
+		evaluate(ctx, "fail_unknown()", &exception);
+		if (exception == 0) goto fail;
+	}
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+bool empty_result(JSContextRef ctx, JSContextJSC& context) {
+	std::cout << "    -- Test:  empty_result... ";
+	{
+		JSObjectPtr global(new JSObjectJSC(ctx, JSContextGetGlobalObject(ctx)));
+		global->set("empty", context.newFunction(JSNativeCallbackPtr(new EmptyCallback())));
+
+		JSValueRef exception = 0;
+		JSValueRef result = evaluate(ctx, "empty()", &exception);
+		if (exception != 0) goto fail;
+		if (!JSValueIsUndefined(ctx, result)) goto fail;
+	}
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+bool call_after_wrapper(JSContextRef ctx) {
+	std::cout << "    -- Test:  call_after_wrapper... ";
+	{
+		{
+			// the function outlives the wrapper it has been created by
+			JSContextJSC context(ctx);
+			JSObjectPtr global(new JSObjectJSC(ctx, JSContextGetGlobalObject(ctx)));
+			global->set("add_later", context.newFunction(CreateNativeCallback(&add)));
+		}
+
+		JSValueRef result = evaluate(ctx, "add_later(2, 3)", 0);
+		if (!JSValueIsNumber(ctx, result)) goto fail;
+		if (JSValueToNumber(ctx, result, 0) != 5.0) goto fail;
+	}
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+bool release_context() {
+	std::cout << "    -- Test:  release_context... ";
+	bool destroyed = false;
+	{
+		JSGlobalContextRef ctx = JSGlobalContextCreate(NULL);
+		{
+			// the function must not keep its own global context alive
+			JSContextJSC context(ctx);
+			JSObjectPtr global(new JSObjectJSC(ctx, JSContextGetGlobalObject(ctx)));
+			global->set("tracked", context.newFunction(JSNativeCallbackPtr(new TrackedCallback(&destroyed))));
+		}
+		JSGlobalContextRelease(ctx);
+		if (!destroyed) goto fail;
+	}
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+bool call_each(JSContextRef ctx, JSContextJSC& context) {
+	std::cout << "    -- Test:  call_each... ";
+	{
+		JSValueRef f = evaluate(ctx, "(function(x, i) { return x * i; })", 0);
+		JSObjectPtr function(new JSObjectJSC(ctx, f, context.getData()));
+
+		JSArrayPtr args = context.newArray(100);
+		for(unsigned int idx = 0; idx < 100; ++idx) {
+			args->setAt(idx, 2.0);
+		}
+		JSArrayPtr results = context.newArray(100);
+		function->callEach(args, results);
+		if (results->getAt(99)->asDouble() != 198.0) goto fail;
+	}
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+int main() {
+
+	int err = 0;
+
+	JSGlobalContextRef context = JSGlobalContextCreate(NULL);
+	JSContextJSC jscontext(context);
+
+	if(!call_from_script(context, jscontext)) err = 1;
+	if(!exception_from_native(context, jscontext)) err = 1;
+	if(!unknown_exception_from_native(context, jscontext)) err = 1;
+	if(!empty_result(context, jscontext)) err = 1;
+	if(!call_after_wrapper(context)) err = 1;
+	if(!call_each(context, jscontext)) err = 1;
+	if(!release_context()) err = 1;
+
+	JSGarbageCollect(context);
+	JSGlobalContextRelease(context);
+
+	return err;
+}
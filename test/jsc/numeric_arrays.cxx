@@ -0,0 +1,95 @@
+#include <JavaScriptCore/JavaScript.h>
+#include <jsobjects_jsc.hpp>
+#include <iostream>
+
+using namespace jsobjects;
+
+bool plain_array(JSContextJSC& context) {
+	std::cout << "    -- Test:  plain_array... ";
+	double values[] = { 1.0, 2.0, 3.0 };
+	double result[3];
+
+	JSArrayPtr arr = context.newArray(3);
+	arr->writeDoubles(0, 3, values);
+	arr->readDoubles(0, 3, result);
+
+	if (arr->getAt(2)->asDouble() != 3.0) goto fail;
+	if (result[0] != 1.0 || result[2] != 3.0) goto fail;
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+#ifdef JSOBJECTS_JSC_HAVE_TYPED_ARRAYS
+bool float64_array(JSContextJSC& context) {
+	std::cout << "    -- Test:  float64_array... ";
+	double values[] = { 1.0, 2.0, 3.0 };
+	double result[3];
+
+	JSArrayPtr arr = context.newFloat64Array(3);
+	arr->writeDoubles(0, 3, values);
+	arr->readDoubles(0, 3, result);
+
+	if (boost::dynamic_pointer_cast<JSArrayJSC>(arr)->getFloat64Data()[1] != 2.0) goto fail;
+	if (arr->length() != 3) goto fail;
+	if (arr->getAt(2)->asDouble() != 3.0) goto fail;
+	if (result[0] != 1.0 || result[2] != 3.0) goto fail;
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+void keep_bytes(void*, void*) {
+}
+
+bool borrowed_float64_array(JSContextJSC& context) {
+	std::cout << "    -- Test:  borrowed_float64_array... ";
+	static double values[] = { 1.0, 2.0, 3.0 };
+	static char bytes[16];
+	double result[3];
+
+	JSArrayPtr arr = context.newFloat64Array(values, 3, keep_bytes, 0);
+	JSObjectPtr buf = context.newArrayBuffer(bytes, sizeof(bytes), keep_bytes, 0);
+	arr->readDoubles(0, 3, result);
+
+	if (arr->length() != 3) goto fail;
+	if (result[0] != 1.0 || result[2] != 3.0) goto fail;
+	// the array writes through to the borrowed bytes
+	arr->setAt(1, 5.0);
+	if (values[1] != 5.0) goto fail;
+	if (buf->getType() != JSValue::Object) goto fail;
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+#endif
+
+int main() {
+
+	int err = 0;
+
+	JSGlobalContextRef context = JSGlobalContextCreate(NULL);
+	JSContextJSC jscontext(context);
+
+	if(!plain_array(jscontext)) err = 1;
+#ifdef JSOBJECTS_JSC_HAVE_TYPED_ARRAYS
+	if(!float64_array(jscontext)) err = 1;
+	if(!borrowed_float64_array(jscontext)) err = 1;
+#endif
+
+  	JSGlobalContextRelease(context);
+
+  	return err;
+}
@@ -0,0 +1,78 @@
+#include <JavaScriptCore/JavaScript.h>
+#include <jsobjects_jsc_pool.hpp>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace jsobjects;
+
+struct SumJob {
+	SumJob(int n, double* result): n(n), result(result) {}
+
+	void operator()(JSContextJSC& context) {
+		JSArrayPtr arr = context.newArray(n);
+		for(int idx = 0; idx < n; ++idx) {
+			arr->setAt(idx, (double) idx);
+		}
+		JSArrayPtr parsed = context.fromJson(context.toJson(arr->toValue(arr)))->asArray();
+		*result = 0;
+		for(unsigned int idx = 0; idx < parsed->length(); ++idx) {
+			*result += parsed->getAt(idx)->asDouble();
+		}
+	}
+
+	int n;
+	double* result;
+};
+
+bool concurrent_jobs() {
+	std::cout << "    -- Test:  concurrent_jobs... ";
+	JSContextPoolJSC pool(2);
+	std::vector<double> results(8);
+	std::vector<std::thread> threads;
+	for(size_t idx = 0; idx < results.size(); ++idx) {
+		threads.push_back(std::thread([&pool, &results, idx]() {
+			pool.run(SumJob(100, &results[idx]));
+		}));
+	}
+	for(size_t idx = 0; idx < threads.size(); ++idx) {
+		threads[idx].join();
+	}
+	for(size_t idx = 0; idx < results.size(); ++idx) {
+		if (results[idx] != 4950) goto fail;
+	}
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+bool thread_lease() {
+	std::cout << "    -- Test:  thread_lease... ";
+	JSContextPoolJSC pool(1);
+	{
+		JSContextPoolJSC::Lease lease(pool);
+		if (JSContextPoolJSC::GetContext().get() != &lease.getContext()) goto fail;
+	}
+	if (JSContextPoolJSC::GetContext()) goto fail;
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+int main() {
+
+	int err = 0;
+
+	if(!concurrent_jobs()) err = 1;
+	if(!thread_lease()) err = 1;
+
+	return err;
+}
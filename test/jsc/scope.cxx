@@ -0,0 +1,143 @@
+#include <JavaScriptCore/JavaScript.h>
+#include <jsobjects_jsc.hpp>
+#include <iostream>
+
+using namespace jsobjects;
+
+bool values_in_scope(JSContextRef ctx, JSContextJSC& context) {
+	std::cout << "    -- Test:  values_in_scope... ";
+	{
+		JSScopeJSC scope(context);
+		JSArrayPtr arr = context.newArray(3);
+		arr->setAt(0, 1.0);
+		arr->setAt(1, "bla");
+		arr->setAt(2, true);
+
+		for(unsigned int idx = 0; idx < arr->length(); ++idx) {
+			JSValuePtr val = arr->getAt(idx);
+			if (val->isUndefined()) goto fail;
+		}
+		JSGarbageCollect(ctx);
+		if (arr->getAt(0)->asDouble() != 1.0) goto fail;
+	}
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+bool long_walk_in_scope(JSContextRef ctx, JSContextJSC& context) {
+	std::cout << "    -- Test:  long_walk_in_scope... ";
+	{
+		JSScopeJSC scope(context);
+		// Note: more elements than the scope has slots
+		JSArrayPtr arr = context.newArray(1000);
+		for(unsigned int idx = 0; idx < arr->length(); ++idx) {
+			arr->setAt(idx, static_cast<double>(idx));
+		}
+		JSGarbageCollect(ctx);
+		for(unsigned int idx = 0; idx < arr->length(); ++idx) {
+			JSValuePtr val = arr->getAt(idx);
+			if (val->asDouble() != idx) goto fail;
+		}
+	}
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+bool escaping_values(JSContextRef ctx, JSContextJSC& context) {
+	std::cout << "    -- Test:  escaping_values... ";
+	JSObjectPtr obj;
+	{
+		JSScopeJSC scope(context);
+		obj = context.newObject();
+		obj->set("a", "bla");
+	}
+	JSGarbageCollect(ctx);
+
+	if (obj->get("a")->asString() != "bla") goto fail;
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+bool values_outlive_context(JSContextRef ctx) {
+	std::cout << "    -- Test:  values_outlive_context... ";
+	JSValuePtr val;
+	{
+		JSContextJSC context(ctx);
+		JSObjectPtr obj = context.newObject();
+		JSArrayPtr arr = context.newArray(1);
+		arr->setAt(0, "bla");
+		obj->set("a", arr->toValue(arr));
+		val = obj->get("a");
+	}
+	JSGarbageCollect(ctx);
+
+	// Note: arrays are detected through the state of the (destroyed) wrapper
+	if (!val->isArray() || val->asArray()->getAt(0)->asString() != "bla") goto fail;
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+bool borrowed_values(JSContextRef ctx, JSContextJSC& context) {
+	std::cout << "    -- Test:  borrowed_values... ";
+	{
+		JSValueRef val = JSValueMakeNumber(ctx, 2.0);
+		JSStackValue<JSValueJSC> borrowed;
+		JSValue* wrapped = borrowed.init(ctx, val, JSBorrowed());
+		if (wrapped->getType() != JSValue::Number) goto fail;
+		if (JSValueJSC_cast(wrapped)->value != val) goto fail;
+	}
+	{
+		// Note: with the state of the context the array check is cached
+		JSArrayPtr arr = context.newArray(1);
+		JSValueRef val = JSValueJSC_cast(JSOBJECTS_PTR_GET(arr))->value;
+		JSStackValue<JSValueJSC> borrowed;
+		JSValue* wrapped = borrowed.init(ctx, val, JSBorrowed(), context.getData());
+		if (JSValueJSC_cast(wrapped)->owner != context.getData()) goto fail;
+		if (!wrapped->isArray()) goto fail;
+	}
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+int main() {
+
+	int err = 0;
+
+	JSGlobalContextRef context = JSGlobalContextCreate(NULL);
+	JSContextJSC jscontext(context);
+
+	if(!values_in_scope(context, jscontext)) err = 1;
+	if(!long_walk_in_scope(context, jscontext)) err = 1;
+	if(!escaping_values(context, jscontext)) err = 1;
+	if(!borrowed_values(context, jscontext)) err = 1;
+	if(!values_outlive_context(context)) err = 1;
+
+  	JSGlobalContextRelease(context);
+
+  	return err;
+}
@@ -1,6 +1,7 @@
 #include <JavaScriptCore/JavaScript.h>
 #include <jsobjects_jsc.hpp>
 #include <iostream>
+#include <string.h>
 
 using namespace jsobjects;
 
@@ -39,6 +40,47 @@ bool unicode(JSContextJSC& context) {
 	return false;
 }
 
+bool reuse_buffer(JSContextJSC& context) {
+	std::cout << "    -- Test:  reuse_buffer... ";
+	std::string buffer;
+
+	context.newString("olé")->asString(buffer);
+	if (buffer != "olé") goto fail;
+
+	context.newString("Hello")->asString(buffer);
+	if (buffer != "Hello") goto fail;
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
+bool for_each_keys(JSContextJSC& context) {
+	std::cout << "    -- Test:  for_each_keys... ";
+	JSObjectPtr obj = context.newObject();
+	std::string keys;
+	double sum = 0;
+
+	obj->set("olé", 1.0);
+	obj->set("Hello", 2.0);
+	obj->forEach([&keys, &sum](const JSStringView& key, JSValue& value) {
+		keys += key.c_str();
+		sum += value.asDouble();
+	});
+	if (keys != "oléHello") goto fail;
+	if (sum != 3.0) goto fail;
+
+	std::cout << "ok." << std::endl;
+	return true;
+
+	fail:
+	std::cout << "failed." << std::endl;
+	return false;
+}
+
 int main() {
 
 	int err = 0;
@@ -49,6 +91,8 @@ int main() {
 
 	if(!simple_ascii(jscontext)) err = 1;
 	if(!unicode(jscontext)) err = 1;
+	if(!reuse_buffer(jscontext)) err = 1;
+	if(!for_each_keys(jscontext)) err = 1;
 
   	JSGlobalContextRelease(context);
 